@@ -0,0 +1,241 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+
+using namespace juce;
+
+
+static double secondsSince (int64 startTicks)
+{
+    return Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - startTicks);
+}
+
+
+bool Benchmark::run (const File& output)
+{
+    // best of a few runs, the others being mostly disturbed by the rest of the system
+    constexpr int numRuns = 5;
+    
+    auto* results = new DynamicObject();
+    results->setProperty ("version", ProjectInfo::versionString);
+    results->setProperty ("cpu", SystemStats::getCpuModel());
+    results->setProperty ("numCpus", SystemStats::getNumCpus());
+   #if JUCE_DEBUG
+    results->setProperty ("configuration", "Debug");
+   #else
+    results->setProperty ("configuration", "Release");
+   #endif
+    
+    
+    // tick map builds: one parameter at a time around a 5 minutes song with 10 tempo changes
+    Array<var> builds;
+    
+    auto addBuild = [&] (int numTempoEntries, int numBarSignatures, double lengthInSeconds) {
+        double milliseconds = std::numeric_limits<double>::max();
+        for (int run = 0 ; run < numRuns ; run++)
+            milliseconds = jmin (milliseconds, measureTickMapBuild (numTempoEntries, numBarSignatures, lengthInSeconds));
+        
+        auto* build = new DynamicObject();
+        build->setProperty ("tempoEntries", numTempoEntries);
+        build->setProperty ("barSignatures", numBarSignatures);
+        build->setProperty ("lengthInSeconds", lengthInSeconds);
+        build->setProperty ("milliseconds", milliseconds);
+        builds.add (var (build));
+    };
+    
+    for (int numTempoEntries : { 2, 10, 100, 1000, 10000 })
+        addBuild (numTempoEntries, 1, 300.0);
+    for (int numBarSignatures : { 10, 100, 1000 })
+        addBuild (10, numBarSignatures, 300.0);
+    for (double lengthInSeconds : { 60.0, 1800.0, 3600.0 })
+        addBuild (10, 1, lengthInSeconds);
+    
+    results->setProperty ("tickMapBuild", builds);
+    
+    
+    // element searches: from a few elements to dense tempo automation over the whole song
+    Array<var> searches;
+    
+    for (int numTempoEntries : { 100, 1000, 10000, 100000, 500000 }) {
+        int numElements = 0;
+        double searchTreeNs = 0.0;
+        double upperBoundNs = 0.0;
+        measureElementSearch (numTempoEntries, numElements, searchTreeNs, upperBoundNs);
+        
+        auto* search = new DynamicObject();
+        search->setProperty ("tempoEntries", numTempoEntries);
+        search->setProperty ("elements", numElements);
+        search->setProperty ("searchTreeNs", searchTreeNs);
+        search->setProperty ("upperBoundNs", upperBoundNs);
+        searches.add (var (search));
+    }
+    
+    results->setProperty ("elementSearch", searches);
+    
+    
+    // rendering: every combination
+    Array<var> renders;
+    
+    for (auto state : { TransportState::stopped, TransportState::playing, TransportState::sendSignalAlways }) {
+        for (double sampleRate : { 44100.0, 48000.0, 96000.0, 192000.0 }) {
+            for (double bpm : { 30.0, 120.0, 400.0 }) {
+                for (int numChannels : { 1, 2, 8 }) {
+                    for (int blockSize : { 16, 64, 256, 1024, 4096, 8192 }) {
+                        double nsPerSample = std::numeric_limits<double>::max();
+                        for (int run = 0 ; run < numRuns ; run++)
+                            nsPerSample = jmin (nsPerSample, measureRender (blockSize, numChannels, sampleRate, bpm, state));
+                        
+                        auto* render = new DynamicObject();
+                        render->setProperty ("state", state == TransportState::stopped ? "stopped"
+                                                      : state == TransportState::playing ? "playing" : "sendSignalAlways");
+                        render->setProperty ("sampleRate", sampleRate);
+                        render->setProperty ("bpm", bpm);
+                        render->setProperty ("channels", numChannels);
+                        render->setProperty ("blockSize", blockSize);
+                        render->setProperty ("nsPerSample", nsPerSample);
+                        renders.add (var (render));
+                    }
+                }
+            }
+        }
+    }
+    
+    results->setProperty ("render", renders);
+    
+    return output.replaceWithText (JSON::toString (var (results)));
+}
+
+
+void Benchmark::makeEvents (int numTempoEntries, int numBarSignatures, double lengthInSeconds,
+                            std::vector<TempoMap::TempoEntry>& tempoEntries, std::vector<TempoMap::BarSignature>& barSignatures)
+{
+    Random random (numTempoEntries * 7919 + numBarSignatures); // the same events for every run
+    
+    tempoEntries.clear();
+    tempoEntries.push_back ({ 0.0, 0.0 });
+    
+    const double sectionLength = lengthInSeconds / (numTempoEntries - 1);
+    for (int i = 1 ; i < numTempoEntries ; i++) {
+        const double bpm = 30.0 + 370.0 * random.nextDouble();
+        tempoEntries.push_back ({ i * sectionLength, tempoEntries.back().quarterPosition + sectionLength * bpm / 60.0 });
+    }
+    
+    const int denominators[] = { 2, 4, 8, 16 };
+    const double songLengthInQuarters = tempoEntries.back().quarterPosition;
+    
+    barSignatures.clear();
+    for (int i = 0 ; i < numBarSignatures ; i++)
+        barSignatures.push_back ({ 1 + random.nextInt (12), denominators[random.nextInt (4)], i * songLengthInQuarters / numBarSignatures });
+}
+
+
+double Benchmark::measureTickMapBuild (int numTempoEntries, int numBarSignatures, double lengthInSeconds)
+{
+    std::vector<TempoMap::TempoEntry> tempoEntries;
+    std::vector<TempoMap::BarSignature> barSignatures;
+    makeEvents (numTempoEntries, numBarSignatures, lengthInSeconds, tempoEntries, barSignatures);
+    
+    const int64 start = Time::getHighResolutionTicks();
+    TempoMap tempoMap (tempoEntries, barSignatures, 48000.0);
+    return 1000.0 * secondsSince (start);
+}
+
+
+void Benchmark::measureElementSearch (int numTempoEntries, int& numElements, double& searchTreeNs, double& upperBoundNs)
+{
+    constexpr int numRuns = 5; // best of, as in run()
+    constexpr int numSearches = 1 << 20;
+    
+    std::vector<TempoMap::TempoEntry> tempoEntries;
+    std::vector<TempoMap::BarSignature> barSignatures;
+    makeEvents (numTempoEntries, 1, 4 * 3600.0, tempoEntries, barSignatures);
+    
+    const TempoMap tempoMap (tempoEntries, barSignatures, 48000.0);
+    const std::vector<int64_t> startPositions = tempoMap.getElementStartPositions();
+    numElements = static_cast<int> (startPositions.size());
+    
+    // the same positions for both searches, from a little before the first element to a little after the last one
+    Random random (numTempoEntries);
+    const double firstPosition = static_cast<double> (startPositions.front());
+    const double songLength = static_cast<double> (startPositions.back()) - firstPosition;
+    
+    std::vector<int64_t> positions (numSearches);
+    for (auto& position : positions)
+        position = static_cast<int64_t> (firstPosition + (1.02 * random.nextDouble() - 0.01) * songLength);
+    
+    searchTreeNs = std::numeric_limits<double>::max();
+    upperBoundNs = std::numeric_limits<double>::max();
+    
+    for (int run = 0 ; run < numRuns ; run++) {
+        size_t searchTreeSum = 0; // also keeps the compiler from dropping the searches
+        int64 start = Time::getHighResolutionTicks();
+        
+        for (const auto position : positions)
+            searchTreeSum += tempoMap.findElementAt (position);
+        
+        searchTreeNs = jmin (searchTreeNs, 1.0e9 * secondsSince (start) / numSearches);
+        
+        // a plain binary search on the same start positions: the element with the last start position at or before the position
+        size_t upperBoundSum = 0;
+        start = Time::getHighResolutionTicks();
+        
+        for (const auto position : positions) {
+            auto it = std::upper_bound (startPositions.begin(), startPositions.end(), position);
+            upperBoundSum += (it != startPositions.begin()) ? static_cast<size_t> (std::distance (startPositions.begin(), it)) - 1 : 0;
+        }
+        
+        upperBoundNs = jmin (upperBoundNs, 1.0e9 * secondsSince (start) / numSearches);
+        
+        jassert (searchTreeSum == upperBoundSum); // both find the same elements
+        ignoreUnused (searchTreeSum, upperBoundSum);
+    }
+}
+
+
+double Benchmark::measureRender (int blockSize, int numChannels, double sampleRate, double bpm, TransportState state)
+{
+    constexpr double lengthInSeconds = 10.0;
+    
+    const std::vector<TempoMap::TempoEntry> tempoEntries { { 0.0, 0.0 }, { 60.0, bpm } };
+    const std::vector<TempoMap::BarSignature> barSignatures { { 4, 4, 0.0 } };
+    TempoMap tempoMap (tempoEntries, barSignatures, sampleRate);
+    
+    SyncSignalRenderer signalRenderer (tempoMap);
+    signalRenderer.setSendSignalAlways (state == TransportState::sendSignalAlways);
+    signalRenderer.prepare (sampleRate, blockSize);
+    
+    AudioBuffer<float> buffer (numChannels, blockSize);
+    const int64 numSamples = static_cast<int64> (lengthInSeconds * sampleRate);
+    const bool isPlaying = (state == TransportState::playing);
+    
+    const int64 start = Time::getHighResolutionTicks();
+    
+    for (int64 position = 0 ; position < numSamples ; position += blockSize)
+        signalRenderer.render (buffer, position, isPlaying);
+    
+    return 1.0e9 * secondsSince (start) / static_cast<double> (numSamples);
+}
@@ -0,0 +1,58 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "../../Source/SyncSignalRenderer.h"
+
+
+// Measures the cost of the plugin code: building a tick map against the number of tempo entries, bar signatures and the
+// length of the song, finding the element at a position (the Eytzinger search tree of the tick maps against a plain
+// std::upper_bound on their start positions), and rendering the signal (SyncSignalRenderer::render(), all of
+// processBlock() but the tick map update) in ns per sample against the block size, the number of channels, the sample
+// rate, the tempo and the transport state. The results are written as JSON so that they can be compared between releases.
+struct Benchmark
+{
+    // Returns false if the results cannot be written
+    static bool run (const juce::File& output);
+    
+    
+private:
+    
+    // random tempo (between 30 and 400 BPM) and bar signature changes, evenly spread over the song
+    static void makeEvents (int numTempoEntries, int numBarSignatures, double lengthInSeconds,
+                            std::vector<TempoMap::TempoEntry>& tempoEntries, std::vector<TempoMap::BarSignature>& barSignatures);
+    
+    static double measureTickMapBuild (int numTempoEntries, int numBarSignatures, double lengthInSeconds); // in ms
+    
+    // in ns per search, for positions spread randomly over a song of 4 hours (numElements is the size of its tick map)
+    static void measureElementSearch (int numTempoEntries, int& numElements, double& searchTreeNs, double& upperBoundNs);
+    
+    enum class TransportState { stopped, playing, sendSignalAlways };
+    
+    static double measureRender (int blockSize, int numChannels, double sampleRate, double bpm, TransportState state); // in ns per sample
+};
@@ -0,0 +1,325 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "Fuzzer.h"
+
+
+using namespace juce;
+
+
+// Every allocation of the program goes through here, so that we can count the ones made by the thread which is currently
+// playing the role of the audio thread (see checkSignal())
+static thread_local bool onAudioThread = false;
+static thread_local int64 numAudioThreadAllocations = 0;
+
+void* operator new (size_t size)
+{
+    if (onAudioThread)
+        numAudioThreadAllocations++;
+    
+    if (void* memory = std::malloc (size > 0 ? size : 1))
+        return memory;
+    
+    throw std::bad_alloc();
+}
+
+void operator delete (void* memory) noexcept
+{
+    std::free (memory);
+}
+
+void operator delete (void* memory, size_t) noexcept
+{
+    std::free (memory);
+}
+
+
+int Fuzzer::run (int64 firstCase, int64 numCases, int numThreads)
+{
+    CriticalSection outputLock;
+    std::atomic<int> numFailures { 0 };
+    std::atomic<int64> nextCase { firstCase };
+    
+    // each thread takes the next case until they are all done, so that the slow ones (long songs) do not hold the others
+    ThreadPool threadPool (numThreads);
+    
+    for (int t = 0 ; t < numThreads ; t++) {
+        threadPool.addJob ([&] {
+            for (int64 caseNumber = nextCase++ ; caseNumber < firstCase + numCases ; caseNumber = nextCase++) {
+                Case fuzzCase;
+                makeCase (caseNumber, fuzzCase);
+                
+                TempoMap tempoMap (fuzzCase.tempoEntries, fuzzCase.barSignatures, fuzzCase.sampleRate);
+                tempoMap.setSubSampleTicks (fuzzCase.subSampleTicks);
+                
+                String error = checkTicks (tempoMap, fuzzCase);
+                if (error.isEmpty())
+                    error = checkSignal (tempoMap, fuzzCase);
+                
+                if (error.isNotEmpty()) {
+                    const ScopedLock lock (outputLock);
+                    std::cerr << "case " << caseNumber << ": " << error << "\n";
+                    numFailures++;
+                }
+            }
+        });
+    }
+    
+    while (threadPool.getNumJobs() > 0)
+        Thread::sleep (10);
+    
+    return numFailures;
+}
+
+
+void Fuzzer::makeCase (int64 caseNumber, Case& fuzzCase)
+{
+    Random random (caseNumber);
+    fuzzCase.number = caseNumber;
+    
+    const double sampleRates[] = { 32000.0, 44100.0, 48000.0, 50000.0, 88200.0, 96000.0, 176400.0, 192000.0, 384000.0 };
+    fuzzCase.sampleRate = sampleRates[random.nextInt (numElementsInArray (sampleRates))];
+    fuzzCase.delay = random.nextBool() ? 0.0 : 0.2 * random.nextDouble() - 0.1;
+    fuzzCase.sendSignalAlways = random.nextBool();
+    fuzzCase.subSampleTicks = random.nextBool();
+    fuzzCase.blockSize = random.nextBool() ? 1 + random.nextInt (64) : 1 << random.nextInt (14);
+    
+    
+    // tempo entries: on ticks, between ticks, or several between 2 ticks; from below 29.55 BPM to above 400.45 BPM
+    fuzzCase.tempoEntries = { { 0.0, 0.0 } };
+    const int numTempoEntries = 1 + random.nextInt (random.nextBool() ? 4 : 40);
+    
+    for (int i = 0 ; i < numTempoEntries ; i++) {
+        const double bpm = 20.0 + 430.0 * random.nextDouble();
+        
+        double quarters;
+        switch (random.nextInt (3)) {
+            case 0:  quarters = (1 + random.nextInt (24 * 32)) / 24.0; break;
+            case 1:  quarters = 0.0001 + 32.0 * random.nextDouble(); break;
+            default: quarters = 0.04 * random.nextDouble() + 0.0001; break;
+        }
+        
+        const TempoMap::TempoEntry& last = fuzzCase.tempoEntries.back();
+        fuzzCase.tempoEntries.push_back ({ last.timePosition + quarters * 60.0 / bpm, last.quarterPosition + quarters });
+    }
+    
+    
+    // bar signatures: on a bar of the previous one or anywhere
+    const int denominators[] = { 1, 2, 4, 8, 16 };
+    double quarter = 0.0;
+    const int numBarSignatures = 1 + random.nextInt (6);
+    
+    for (int i = 0 ; i < numBarSignatures ; i++) {
+        const TempoMap::BarSignature barSignature { 1 + random.nextInt (16), denominators[random.nextInt (numElementsInArray (denominators))], quarter };
+        fuzzCase.barSignatures.push_back (barSignature);
+        
+        const double quartersPerBar = 4.0 * barSignature.numerator / barSignature.denominator;
+        quarter += random.nextBool() ? quartersPerBar * (1 + random.nextInt (8)) : 0.5 + 32.0 * random.nextDouble();
+    }
+    
+    
+    // the transport: mostly playing, with seeks (also before the start of the song), loops and stops
+    const double songLength = fuzzCase.tempoEntries.back().timePosition + 2.0;
+    const int numCommands = 1 + random.nextInt (12);
+    
+    for (int i = 0 ; i < numCommands ; i++) {
+        TransportScript::Command command { TransportScript::Command::play, 0.0, 0.0, 0.1 + 3.0 * random.nextDouble() };
+        
+        switch (random.nextInt (6)) {
+            case 0:
+                command.type = TransportScript::Command::stop;
+                break;
+            case 1:
+                command.type = TransportScript::Command::seek;
+                command.position = songLength * random.nextDouble() - 1.0;
+                break;
+            case 2:
+                command.type = TransportScript::Command::preroll;
+                command.duration = 2.0 * random.nextDouble();
+                break;
+            case 3:
+                command.type = TransportScript::Command::loop;
+                command.position = songLength * random.nextDouble() - 1.0;
+                command.loopEnd = command.position + 0.001 + 2.0 * random.nextDouble();
+                break;
+            default:
+                break;
+        }
+        
+        fuzzCase.transportScript.commands.push_back (command);
+    }
+}
+
+
+String Fuzzer::checkTicks (TempoMap& tempoMap, const Case& fuzzCase)
+{
+    const double sampleRate = fuzzCase.sampleRate;
+    const int64 start = static_cast<int64> (-sampleRate);
+    const int64 end = static_cast<int64> ((fuzzCase.tempoEntries.back().timePosition + 1.0) * sampleRate);
+    
+    // all the ticks, in blocks of random sizes
+    std::vector<TempoMap::Tick> ticks, blockTicks;
+    TempoMap::Tick tickAfterBlock { 0, false };
+    Random random (fuzzCase.number + 1);
+    
+    for (int64 blockStart = start ; blockStart < end ; ) {
+        const int blockSize = 1 + random.nextInt (8192);
+        blockTicks.resize (static_cast<size_t> (blockSize) + 1);
+        
+        const int numTicks = tempoMap.getTicksInBlock (blockStart, blockStart + blockSize, blockTicks.data(), (int) blockTicks.size(), tickAfterBlock);
+        ticks.insert (ticks.end(), blockTicks.begin(), blockTicks.begin() + numTicks);
+        blockStart += blockSize;
+    }
+    
+    auto toTime = [sampleRate] (int64 position) { return String (static_cast<double> (position) / sampleRate, 6) + " s"; };
+    
+    for (size_t i = 1 ; i < ticks.size() ; i++) {
+        if (ticks[i].position <= ticks[i-1].position)
+            return "ticks not increasing at " + toTime (ticks[i].position);
+    }
+    
+    // the same ticks one at a time, from random positions
+    for (int n = 0 ; n < 200 && !ticks.empty() ; n++) {
+        const int64 position = start + static_cast<int64> (random.nextDouble() * static_cast<double> (ticks.back().position - start));
+        
+        bool lastTickRightBeforeABar = false;
+        const int64 tickPosition = tempoMap.getNextTickPositionInSamples (position, lastTickRightBeforeABar);
+        
+        const auto tick = std::lower_bound (ticks.begin(), ticks.end(), position, [] (const TempoMap::Tick& t, int64 p) { return t.position < p; });
+        if (tick->position != tickPosition || tick->lastTickRightBeforeABar != lastTickRightBeforeABar)
+            return "next tick from " + toTime (position) + " differs from the block ticks";
+    }
+    
+    // The bars as the bar signatures of the case give them, in ticks from the first tempo entry: a bar signature has whole
+    // quarters per bar (at least one, 7/8 has bars of 3 quarters), and starts on the first quarter on a bar of the previous
+    // one, which it replaces if it is not after it
+    struct Bars { int64 firstTick; int64 length; };
+    std::vector<Bars> bars;
+    
+    for (const auto& barSignature : fuzzCase.barSignatures) {
+        Bars barSignatureBars { 24 * static_cast<int64> (std::round (barSignature.position)), 24 * jmax (1, 4 * barSignature.numerator / barSignature.denominator) };
+        
+        if (!bars.empty() && barSignatureBars.firstTick <= bars.back().firstTick) {
+            barSignatureBars.firstTick = bars.back().firstTick;
+            bars.pop_back();
+        }
+        else if (!bars.empty()) {
+            const int64 remainder = (barSignatureBars.firstTick - bars.back().firstTick) % bars.back().length;
+            if (remainder != 0)
+                barSignatureBars.firstTick += bars.back().length - remainder;
+        }
+        
+        bars.push_back (barSignatureBars);
+    }
+    
+    // tick 0 is at position 0 (the delay is not set yet), the ticks before it are the pre-roll
+    const auto firstTick = std::lower_bound (ticks.begin(), ticks.end(), -static_cast<int64> (sampleRate * SyncSignal::minTickLengthInSeconds / 2.0),
+                                             [] (const TempoMap::Tick& t, int64 p) { return t.position < p; });
+    
+    for (auto tick = firstTick ; tick != ticks.end() ; tick++) {
+        const int64 nextTickIndex = (tick - firstTick) + 1;
+        
+        const auto nextTickBars = std::prev (std::upper_bound (bars.begin(), bars.end(), nextTickIndex, [] (int64 t, const Bars& b) { return t < b.firstTick; }));
+        const bool lastTickRightBeforeABar = (nextTickIndex - nextTickBars->firstTick) % nextTickBars->length == 0;
+        
+        if (tick->lastTickRightBeforeABar != lastTickRightBeforeABar)
+            return "tick " + String (nextTickIndex - 1) + " at " + toTime (tick->position) + (lastTickRightBeforeABar ? " should" : " should not")
+                       + " be the last one before a bar";
+    }
+    
+    return {};
+}
+
+
+String Fuzzer::checkSignal (TempoMap& tempoMap, const Case& fuzzCase)
+{
+    const double sampleRate = fuzzCase.sampleRate;
+    const int64 minSamplesBetweenTicks = static_cast<int64> (ceil (SyncSignal::minTickLengthInSeconds * sampleRate));
+    const int64 maxSamplesBetweenTicks = static_cast<int64> (floor (SyncSignal::maxTickLengthInSeconds * sampleRate));
+    
+    tempoMap.setDelay (fuzzCase.delay);
+    
+    SyncSignalRenderer signalRenderer (tempoMap);
+    signalRenderer.setSendSignalAlways (fuzzCase.sendSignalAlways);
+    signalRenderer.prepare (sampleRate, fuzzCase.blockSize);
+    
+    AudioBuffer<float> blockData (2, fuzzCase.blockSize);
+    
+    // positions in the rendered signal, not on the timeline
+    int64 outputPosition = 0;
+    int64 lastPulse = -maxSamplesBetweenTicks;
+    int64 sendingSince = 0; // the signal is not sent while stopped (unless sendSignalAlways), there is no maximum then
+    bool lastSampleWasSilent = true;
+    String error;
+    
+    const std::function<bool (const AudioBuffer<float>&, bool)> blockRendered = [&] (const AudioBuffer<float>& block, bool isPlaying) {
+        const ScopedValueSetter<bool> notOnAudioThread (onAudioThread, false);
+        
+        const bool sending = isPlaying || fuzzCase.sendSignalAlways;
+        if (!sending)
+            sendingSince = outputPosition + block.getNumSamples();
+        
+        const float* left = block.getReadPointer (0);
+        const float* right = block.getReadPointer (1);
+        
+        for (int i = 0 ; i < block.getNumSamples() ; i++, outputPosition++) {
+            if (left[i] != right[i]) {
+                error = "channels differ";
+                return false;
+            }
+            
+            const bool silent = (left[i] == 0.0f);
+            
+            if (!silent && lastSampleWasSilent) {
+                if (outputPosition - lastPulse < minSamplesBetweenTicks) {
+                    error = "pulses " + String (outputPosition - lastPulse) + " samples apart";
+                    return false;
+                }
+                
+                lastPulse = outputPosition;
+            }
+            
+            if (sending && outputPosition - std::max (lastPulse, sendingSince) > maxSamplesBetweenTicks) {
+                error = "no pulse for more than " + String (maxSamplesBetweenTicks) + " samples";
+                return false;
+            }
+            
+            lastSampleWasSilent = silent;
+        }
+        
+        return true;
+    };
+    
+    // the thread is the audio thread whenever it is inside the transport script (i.e. in the renderer), but not in blockRendered
+    numAudioThreadAllocations = 0;
+    onAudioThread = true;
+    fuzzCase.transportScript.render (signalRenderer, sampleRate, blockData, blockRendered);
+    onAudioThread = false;
+    
+    if (error.isEmpty() && numAudioThreadAllocations > 0)
+        error = String (numAudioThreadAllocations) + " allocations while rendering";
+    
+    return error.isEmpty() ? String() : error + " (" + String (outputPosition / sampleRate, 6) + " s into the transport script)";
+}
@@ -0,0 +1,67 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "TransportScript.h"
+
+
+// Randomized checks of the tick map builds and of the signal renderer. Each case draws a song (tempo changes on and between
+// ticks, bar signatures down to 1/16, changes which are not on a bar...), a sample rate, a delay, rounded or sub-sample ticks and a transport script, and
+// checks that:
+// - the ticks are strictly increasing, and the same whether they are asked for block by block or one at a time
+// - the last tick before a bar is exactly where the bar signatures of the song put it
+// - two pulses of the signal are never closer than SyncSignal::minTickLengthInSeconds, and never further apart than
+//   SyncSignal::maxTickLengthInSeconds while the signal is sent
+// - the renderer never allocates memory
+// A case only depends on its number, so a failing case can be run again on its own with --fuzz=1 --seed=<its number>.
+struct Fuzzer
+{
+    // runs the cases firstCase to firstCase+numCases-1 on numThreads threads, returns the number of failing cases
+    static int run (juce::int64 firstCase, juce::int64 numCases, int numThreads);
+    
+    
+private:
+    
+    struct Case {
+        juce::int64 number;
+        std::vector<TempoMap::TempoEntry> tempoEntries;
+        std::vector<TempoMap::BarSignature> barSignatures;
+        double sampleRate;
+        double delay;
+        bool sendSignalAlways;
+        bool subSampleTicks;
+        int blockSize;
+        TransportScript transportScript;
+    };
+    
+    static void makeCase (juce::int64 caseNumber, Case& fuzzCase);
+    
+    // Return a description of the first problem found, or an empty string
+    static juce::String checkTicks (TempoMap& tempoMap, const Case& fuzzCase);
+    static juce::String checkSignal (TempoMap& tempoMap, const Case& fuzzCase);
+};
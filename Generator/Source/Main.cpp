@@ -0,0 +1,210 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "SongEvents.h"
+#include "TransportScript.h"
+#include "Benchmark.h"
+#include "SignalCheck.h"
+#include "Fuzzer.h"
+#include "../../Source/SyncFileExporter.h"
+
+
+using namespace juce;
+
+
+static void printUsage()
+{
+    std::cout << "Generates MidroSync audio files (the signal of the MidroAudioSync plugin) without a DAW.\n\n"
+              << "usage: MidroSyncFileGenerator [options] <file or folder>...\n\n"
+              << "Each Standard MIDI File (.mid, .midi) or JSON file (see SongEvents.h) gives a WAV file with the same name.\n\n"
+              << "options:\n"
+              << "    --samplerate=<Hz>      default 48000, see also --check\n"
+              << "    --bits=<16|24|32>      default 16\n"
+              << "    --channels=<n>         default 2\n"
+              << "    --delay=<ms>           negative or positive, default 0\n"
+              << "    --length=<seconds>     instead of the length of the song\n"
+              << "    --output=<folder>      default: next to each input file\n"
+              << "    --jobs=<n>             songs rendered at the same time, default: one per CPU\n"
+              << "    --subsample            places each pulse within 1/64 sample of its tick instead of on the nearest sample\n\n"
+              << "    --transport=<file>     renders a transport script (see TransportScript.h) instead of the whole song,\n"
+              << "                           block by block, as the plugin does in a host\n"
+              << "    --blocksize=<n>        with --transport, default 512\n"
+              << "    --always               with --transport, keeps sending the signal while stopped\n\n"
+              << "    --check                checks the signal of each song instead of writing it: the same with any block\n"
+              << "                           size and with the export, and its pulses on the ticks of the tempo entries, at\n"
+              << "                           44.1, 48, 96, 192 and 44.056kHz unless --samplerate is given (e.g. on the Tests folder)\n"
+              << "    --benchmark=<file>     measures the tick map builds, the element searches and the rendering, and\n"
+              << "                           writes the results as JSON into file (no input file needed)\n"
+              << "    --fuzz=<n>             checks n random songs and transports on --jobs threads (no input file needed)\n"
+              << "    --seed=<n>             with --fuzz, number of the first case, default 0\n";
+}
+
+
+int main (int argc, char* argv[])
+{
+    double givenSampleRate = 0.0; // see sampleRates below
+    int bitsPerSample = 16;
+    int numChannels = 2;
+    double delay = 0.0;
+    double length = 0.0;
+    File outputFolder;
+    int numJobs = SystemStats::getNumCpus();
+    Array<File> inputFiles;
+    File transportFile;
+    int blockSize = 512;
+    bool sendSignalAlways = false;
+    bool subSampleTicks = false;
+    File benchmarkFile;
+    bool check = false;
+    int64 numFuzzCases = 0;
+    int64 firstFuzzCase = 0;
+    
+    for (int i = 1 ; i < argc ; i++) {
+        const String arg (CharPointer_UTF8 (argv[i]));
+        const String value = arg.fromFirstOccurrenceOf ("=", false, false);
+        
+        if (arg.startsWith ("--samplerate="))   givenSampleRate = value.getDoubleValue();
+        else if (arg.startsWith ("--bits="))    bitsPerSample = value.getIntValue();
+        else if (arg.startsWith ("--channels=")) numChannels = value.getIntValue();
+        else if (arg.startsWith ("--delay="))   delay = value.getDoubleValue() / 1000.0;
+        else if (arg.startsWith ("--length="))  length = value.getDoubleValue();
+        else if (arg.startsWith ("--output="))  outputFolder = File::getCurrentWorkingDirectory().getChildFile (value);
+        else if (arg.startsWith ("--jobs="))    numJobs = value.getIntValue();
+        else if (arg.startsWith ("--transport=")) transportFile = File::getCurrentWorkingDirectory().getChildFile (value);
+        else if (arg.startsWith ("--blocksize=")) blockSize = value.getIntValue();
+        else if (arg == "--always")             sendSignalAlways = true;
+        else if (arg == "--subsample")          subSampleTicks = true;
+        else if (arg == "--check")              check = true;
+        else if (arg.startsWith ("--fuzz="))    numFuzzCases = value.getLargeIntValue();
+        else if (arg.startsWith ("--seed="))    firstFuzzCase = value.getLargeIntValue();
+        else if (arg.startsWith ("--benchmark=")) benchmarkFile = File::getCurrentWorkingDirectory().getChildFile (value);
+        else if (arg.startsWith ("-")) {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+        else {
+            const File input = File::getCurrentWorkingDirectory().getChildFile (arg);
+            
+            if (input.isDirectory())
+                inputFiles.addArray (input.findChildFiles (File::findFiles, false, "*.mid;*.midi;*.json"));
+            else
+                inputFiles.add (input);
+        }
+    }
+    
+    if (benchmarkFile != File())
+        return Benchmark::run (benchmarkFile) ? 0 : 1;
+    
+    if (numFuzzCases > 0) {
+        const int numFailures = Fuzzer::run (firstFuzzCase, numFuzzCases, jmax (1, numJobs));
+        std::cout << numFuzzCases << " cases, " << numFailures << " failures\n";
+        return numFailures > 0 ? 1 : 0;
+    }
+    
+    if (inputFiles.isEmpty() || givenSampleRate < 0.0 || numChannels <= 0 || numJobs <= 0 || blockSize <= 0) {
+        printUsage();
+        return 1;
+    }
+    
+    TransportScript transportScript;
+    if (transportFile != File()) {
+        const String error = TransportScript::readFromFile (transportFile, transportScript);
+        if (error.isNotEmpty()) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+    
+    if (outputFolder != File() && !outputFolder.createDirectory())
+        return 1;
+    
+    // 48kHz by default; the check goes through the usual sample rates, and an unusual one (44.1kHz pulled down for NTSC video)
+    Array<double> sampleRates { givenSampleRate };
+    if (givenSampleRate == 0.0)
+        sampleRates = check ? Array<double> { 44100.0, 48000.0, 96000.0, 192000.0, 44056.0 } : Array<double> { 48000.0 };
+    
+    
+    // one song per job; a song on its own gets all the CPUs for its rendering instead
+    numJobs = jmin (numJobs, inputFiles.size());
+    const int numRenderThreads = (numJobs == 1) ? 0 : 1;
+    
+    CriticalSection outputLock;
+    std::atomic<int> numFailures { 0 };
+    
+    {
+        ThreadPool threadPool (numJobs);
+        
+        for (const File& input : inputFiles) {
+            threadPool.addJob ([&, input] {
+                const File output = (outputFolder != File() ? outputFolder : input.getParentDirectory())
+                                        .getChildFile (input.getFileNameWithoutExtension() + ".wav");
+                
+                SongEvents events;
+                String error = SongEvents::readFromFile (input, events);
+                
+                for (int r = 0 ; r < sampleRates.size() && error.isEmpty() ; r++) {
+                    const double sampleRate = sampleRates[r];
+                    
+                    TempoMap tempoMap (events.tempoEntries, events.barSignatures, sampleRate);
+                    tempoMap.setDelay (delay);
+                    tempoMap.setSubSampleTicks (subSampleTicks);
+                    
+                    const double lengthInSeconds = (length > 0.0) ? length : events.lengthInSeconds;
+                    bool written = true;
+                    
+                    if (check)
+                        error = SignalCheck::checkSong (tempoMap, events, sampleRate, static_cast<int64_t> (ceil (lengthInSeconds * sampleRate)));
+                    else if (transportFile != File())
+                        written = transportScript.renderToWav (tempoMap, sampleRate, blockSize, sendSignalAlways, output, numChannels, bitsPerSample);
+                    else
+                        written = SyncFileExporter::exportToWav (tempoMap, sampleRate, static_cast<int64_t> (ceil (lengthInSeconds * sampleRate)),
+                                                                 output, numChannels, bitsPerSample, numRenderThreads);
+                    
+                    if (!written)
+                        error = "cannot write " + output.getFullPathName();
+                    else if (error.isNotEmpty() && sampleRates.size() > 1)
+                        error = "at " + String (sampleRate) + " Hz, " + error;
+                }
+                
+                const ScopedLock lock (outputLock);
+                
+                if (error.isEmpty()) {
+                    std::cout << input.getFileName() << (check ? ": ok" : " -> " + output.getFullPathName()) << "\n";
+                }
+                else {
+                    std::cerr << input.getFileName() << ": " << error << "\n";
+                    numFailures++;
+                }
+            });
+        }
+        
+        while (threadPool.getNumJobs() > 0)
+            Thread::sleep (10);
+    }
+    
+    return numFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "SignalCheck.h"
+#include "../../Source/SyncFileExporter.h"
+
+
+using namespace juce;
+
+
+static String toTime (int64_t position, double sampleRate)
+{
+    return String (static_cast<double> (position) / sampleRate, 6) + " s";
+}
+
+
+String SignalCheck::checkSong (TempoMap& tempoMap, const SongEvents& events, double sampleRate, int64_t lengthInSamples)
+{
+    std::vector<float> signal, other;
+    renderWithBlockSize (tempoMap, sampleRate, 8192, lengthInSamples, signal);
+    
+    for (int blockSize : { 1, 441 }) {
+        renderWithBlockSize (tempoMap, sampleRate, blockSize, lengthInSamples, other);
+        
+        const auto difference = std::mismatch (signal.begin(), signal.end(), other.begin());
+        if (difference.first != signal.end())
+            return "blocks of " + String (blockSize) + " and 8192 samples differ at "
+                       + toTime (difference.first - signal.begin(), sampleRate);
+    }
+    
+    if (!renderWithExporter (tempoMap, sampleRate, lengthInSamples, other))
+        return "cannot export the signal";
+    
+    const auto difference = std::mismatch (signal.begin(), signal.end(), other.begin());
+    if (difference.first != signal.end())
+        return "the export and the playback differ at " + toTime (difference.first - signal.begin(), sampleRate);
+    
+    return checkPulses (signal, getReferenceTicks (events, sampleRate, tempoMap.getDelay(), lengthInSamples), sampleRate);
+}
+
+
+void SignalCheck::renderWithBlockSize (TempoMap& tempoMap, double sampleRate, int blockSize, int64_t lengthInSamples, std::vector<float>& signal)
+{
+    // playing from position 0 after prepareToPlay(), as SyncFileExporter does
+    SyncSignalRenderer signalRenderer (tempoMap);
+    signalRenderer.prepare (sampleRate, blockSize);
+    
+    signal.assign (static_cast<size_t> (lengthInSamples), 0.0f);
+    
+    for (int64_t position = 0 ; position < lengthInSamples ; position += blockSize) {
+        float* blockData = signal.data() + position;
+        AudioBuffer<float> block (&blockData, 1, static_cast<int> (std::min (static_cast<int64_t> (blockSize), lengthInSamples - position)));
+        signalRenderer.render (block, position, true);
+    }
+}
+
+
+bool SignalCheck::renderWithExporter (TempoMap& tempoMap, double sampleRate, int64_t lengthInSamples, std::vector<float>& signal)
+{
+    // 32 bits = floating point samples, so that they can be compared exactly
+    TemporaryFile file (".wav");
+    if (!SyncFileExporter::exportToWav (tempoMap, sampleRate, lengthInSamples, file.getFile(), 1, 32))
+        return false;
+    
+    WavAudioFormat wavFormat;
+    std::unique_ptr<AudioFormatReader> reader (wavFormat.createReaderFor (file.getFile().createInputStream().release(), true));
+    if (reader == nullptr || reader->lengthInSamples != lengthInSamples)
+        return false;
+    
+    signal.assign (static_cast<size_t> (lengthInSamples), 0.0f);
+    float* channels[] = { signal.data() };
+    AudioBuffer<float> buffer (channels, 1, static_cast<int> (lengthInSamples));
+    
+    reader->read (&buffer, 0, buffer.getNumSamples(), 0, true, false);
+    return true;
+}
+
+
+std::vector<double> SignalCheck::getReferenceTicks (const SongEvents& events, double sampleRate, double delay, int64_t lengthInSamples)
+{
+    const std::vector<TempoMap::TempoEntry>& tempoEntries = events.tempoEntries;
+    std::vector<double> ticks;
+    
+    // the tempo of the first (resp. last) section also applies before (resp. after) it
+    size_t section = 0;
+    auto secondsPerQuarter = [&tempoEntries] (size_t s) {
+        return (tempoEntries[s+1].timePosition - tempoEntries[s].timePosition) / (tempoEntries[s+1].quarterPosition - tempoEntries[s].quarterPosition);
+    };
+    
+    // a positive delay brings ticks from before the start of the song
+    const double firstQuarter = tempoEntries[0].quarterPosition - std::max (0.0, delay) / secondsPerQuarter (0) - 1.0;
+    
+    for (int64_t tick = static_cast<int64_t> (floor (firstQuarter * 24.0)) ; ; tick++) {
+        const double quarter = static_cast<double> (tick) / 24.0;
+        
+        while (section + 2 < tempoEntries.size() && quarter >= tempoEntries[section+1].quarterPosition)
+            section++;
+        
+        const double time = tempoEntries[section].timePosition + (quarter - tempoEntries[section].quarterPosition) * secondsPerQuarter (section);
+        const double position = (time + delay) * sampleRate;
+        
+        if (position >= static_cast<double> (lengthInSamples))
+            break;
+        
+        if (position >= 0.0)
+            ticks.push_back (position);
+    }
+    
+    return ticks;
+}
+
+
+String SignalCheck::checkPulses (const std::vector<float>& signal, const std::vector<double>& referenceTicks, double sampleRate)
+{
+    // the same limits as the playback renderer
+    const int64_t minSamplesBetweenTicks = static_cast<int64_t> (ceil (SyncSignal::minTickLengthInSeconds * sampleRate));
+    const int64_t maxSamplesBetweenTicks = static_cast<int64_t> (floor (SyncSignal::maxTickLengthInSeconds * sampleRate));
+    
+    // pulses are always separated by silence, since they are shorter than the minimum spacing
+    std::vector<int64_t> pulses;
+    for (size_t i = 0 ; i < signal.size() ; i++) {
+        if (signal[i] != 0.0f && (i == 0 || signal[i-1] == 0.0f))
+            pulses.push_back (static_cast<int64_t> (i));
+    }
+    
+    auto isOnTime = [] (double reference, int64_t pulse) { return std::abs (reference - static_cast<double> (pulse)) < toleranceInSamples; };
+    
+    // every pulse is on a tick, or sent to maintain the minimum tempo
+    int64_t lastPulse = -minSamplesBetweenTicks; // as after prepareToPlay()
+    
+    for (int64_t pulse : pulses) {
+        const auto tick = std::lower_bound (referenceTicks.begin(), referenceTicks.end(), static_cast<double> (pulse) - toleranceInSamples);
+        
+        if ((tick == referenceTicks.end() || !isOnTime (*tick, pulse)) && pulse - lastPulse != maxSamplesBetweenTicks)
+            return "pulse at " + toTime (pulse, sampleRate) + " is not on a tick";
+        
+        lastPulse = pulse;
+    }
+    
+    // every tick has its pulse, unless it comes too soon after the previous one (including when it is due during it)
+    for (double tick : referenceTicks) {
+        const auto pulse = std::lower_bound (pulses.begin(), pulses.end(), static_cast<int64_t> (ceil (tick - toleranceInSamples)));
+        
+        if (pulse != pulses.end() && isOnTime (tick, *pulse))
+            continue;
+        
+        const int64_t previousPulse = (pulse != pulses.begin()) ? *std::prev (pulse) : -minSamplesBetweenTicks;
+        if (tick - static_cast<double> (previousPulse) < static_cast<double> (minSamplesBetweenTicks) + toleranceInSamples)
+            continue;
+        
+        // the last pulse can be cut by the end of the song
+        if (tick + toleranceInSamples >= static_cast<double> (signal.size()))
+            continue;
+        
+        return "tick at " + toTime (static_cast<int64_t> (tick), sampleRate) + " was not sent";
+    }
+    
+    return {};
+}
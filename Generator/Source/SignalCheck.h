@@ -0,0 +1,59 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "SongEvents.h"
+#include "../../Source/SyncSignalRenderer.h"
+
+
+// Regression checks of the signal of a song, meant to be run on a corpus of songs at several sample rates before a release:
+// - the signal must not depend on the block size: blocks of 1 sample, of an odd size and of 8192 samples, and the offline
+//   export, must all give exactly the same samples (the ticks carried over to the next block, the spacing between ticks...)
+// - its pulses are then compared to tick positions computed directly from the tempo entries (24 ticks per quarter, the
+//   tempo constant between 2 entries), which do not use the tick map at all: every pulse must be on a tick, unless it was
+//   sent to maintain the minimum tempo, and every tick must have its pulse, unless it was too close to the previous one.
+struct SignalCheck
+{
+    // tempoMap is built from events at sampleRate, with its delay already set. Returns a description of the first problem
+    // found, or an empty string if there is none.
+    static juce::String checkSong (TempoMap& tempoMap, const SongEvents& events, double sampleRate, int64_t lengthInSamples);
+    
+    
+private:
+    
+    static void renderWithBlockSize (TempoMap& tempoMap, double sampleRate, int blockSize, int64_t lengthInSamples, std::vector<float>& signal);
+    static bool renderWithExporter (TempoMap& tempoMap, double sampleRate, int64_t lengthInSamples, std::vector<float>& signal);
+    
+    // in samples, not rounded
+    static std::vector<double> getReferenceTicks (const SongEvents& events, double sampleRate, double delay, int64_t lengthInSamples);
+    
+    static juce::String checkPulses (const std::vector<float>& signal, const std::vector<double>& referenceTicks, double sampleRate);
+    
+    // a tick is on time if it is less than this away from its reference (the ticks are rounded to the nearest sample)
+    static constexpr double toleranceInSamples = 1.0;
+};
@@ -0,0 +1,140 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "SongEvents.h"
+
+
+using namespace juce;
+
+
+String SongEvents::readFromFile (const File& file, SongEvents& events)
+{
+    events = SongEvents();
+    
+    const String error = file.hasFileExtension ("mid;midi") ? readFromMidiFile (file, events) : readFromJsonFile (file, events);
+    if (error.isNotEmpty())
+        return error;
+    
+    if (events.tempoEntries.size() < 2 || events.barSignatures.empty())
+        return "at least 2 tempo entries and 1 bar signature are needed";
+    
+    for (size_t i = 1 ; i < events.tempoEntries.size() ; i++) {
+        if (events.tempoEntries[i].timePosition <= events.tempoEntries[i-1].timePosition
+            || events.tempoEntries[i].quarterPosition <= events.tempoEntries[i-1].quarterPosition)
+            return "the tempo entries must be in order";
+    }
+    
+    for (const auto& barSignature : events.barSignatures) {
+        if (barSignature.numerator <= 0 || barSignature.denominator <= 0)
+            return "invalid bar signature";
+    }
+    
+    if (events.lengthInSeconds <= 0.0)
+        events.lengthInSeconds = events.tempoEntries.back().timePosition;
+    
+    return {};
+}
+
+
+String SongEvents::readFromMidiFile (const File& file, SongEvents& events)
+{
+    FileInputStream stream (file);
+    MidiFile midiFile;
+    
+    if (!stream.openedOk() || !midiFile.readFrom (stream))
+        return "cannot read the MIDI file";
+    
+    const short timeFormat = midiFile.getTimeFormat();
+    if (timeFormat <= 0)
+        return "SMPTE time format is not supported";
+    
+    const double ticksPerQuarter = timeFormat;
+    
+    // the time stamps are still in MIDI ticks here
+    MidiMessageSequence tempoEvents, timeSigEvents;
+    midiFile.findAllTempoEvents (tempoEvents);
+    midiFile.findAllTimeSigEvents (timeSigEvents);
+    
+    double time = 0.0;
+    double quarter = 0.0;
+    double secondsPerQuarter = 0.5; // 120 BPM until the first tempo event
+    events.tempoEntries.push_back({0.0, 0.0});
+    
+    for (int i = 0 ; i < tempoEvents.getNumEvents() ; i++) {
+        const MidiMessage& message = tempoEvents.getEventPointer(i)->message;
+        const double eventQuarter = message.getTimeStamp() / ticksPerQuarter;
+        
+        if (eventQuarter > quarter) {
+            time += (eventQuarter - quarter) * secondsPerQuarter;
+            quarter = eventQuarter;
+            events.tempoEntries.push_back({time, quarter});
+        }
+        
+        secondsPerQuarter = message.getTempoSecondsPerQuarterNote();
+    }
+    
+    // the last tempo goes on up to the end of the song (and at least for one quarter, so that the last entry gives it)
+    const double endQuarter = midiFile.getLastTimestamp() / ticksPerQuarter;
+    const double lastQuarter = std::max(endQuarter, quarter + 1.0);
+    events.tempoEntries.push_back({time + (lastQuarter - quarter) * secondsPerQuarter, lastQuarter});
+    events.lengthInSeconds = time + (std::max(endQuarter, quarter) - quarter) * secondsPerQuarter;
+    
+    for (int i = 0 ; i < timeSigEvents.getNumEvents() ; i++) {
+        const MidiMessage& message = timeSigEvents.getEventPointer(i)->message;
+        int numerator = 4, denominator = 4;
+        message.getTimeSignatureInfo (numerator, denominator);
+        
+        events.barSignatures.push_back({numerator, denominator, message.getTimeStamp() / ticksPerQuarter});
+    }
+    
+    if (events.barSignatures.empty() || events.barSignatures.front().position > 0.0)
+        events.barSignatures.insert(events.barSignatures.begin(), {4, 4, 0.0}); // the MIDI default
+    
+    return {};
+}
+
+
+String SongEvents::readFromJsonFile (const File& file, SongEvents& events)
+{
+    var json;
+    const Result result = JSON::parse (file.loadFileAsString(), json);
+    
+    if (result.failed())
+        return "cannot read the JSON file: " + result.getErrorMessage();
+    
+    if (const Array<var>* tempo = json["tempo"].getArray()) {
+        for (const var& entry : *tempo)
+            events.tempoEntries.push_back({(double)entry["time"], (double)entry["quarter"]});
+    }
+    
+    if (const Array<var>* barSignatures = json["barSignatures"].getArray()) {
+        for (const var& barSignature : *barSignatures)
+            events.barSignatures.push_back({(int)barSignature["numerator"], (int)barSignature["denominator"], (double)barSignature["quarter"]});
+    }
+    
+    events.lengthInSeconds = json.getProperty ("length", 0.0);
+    
+    return {};
+}
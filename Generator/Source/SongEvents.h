@@ -0,0 +1,56 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "../../Source/TempoMap.h"
+
+
+// The tempo and bar signature events of a song, read from a file instead of an ARA host
+struct SongEvents
+{
+    std::vector<TempoMap::TempoEntry> tempoEntries; // same as ARA: the tempo is constant between 2 entries, there are at least 2
+    std::vector<TempoMap::BarSignature> barSignatures;
+    double lengthInSeconds = 0.0; // end of the song
+    
+    
+    // Reads a Standard MIDI File (.mid, .midi: its tempo and time signature meta events, up to its last event) or a JSON file:
+    //     {
+    //         "tempo": [ { "time": 0.0, "quarter": 0.0 }, { "time": 120.0, "quarter": 240.0 } ],
+    //         "barSignatures": [ { "numerator": 4, "denominator": 4, "quarter": 0.0 } ],
+    //         "length": 120.0
+    //     }
+    // (time and length in seconds, "length" is optional and defaults to the last tempo entry).
+    // Returns an error message, or an empty string if the events can be used.
+    static juce::String readFromFile (const juce::File& file, SongEvents& events);
+    
+    
+private:
+    
+    static juce::String readFromMidiFile (const juce::File& file, SongEvents& events);
+    static juce::String readFromJsonFile (const juce::File& file, SongEvents& events);
+};
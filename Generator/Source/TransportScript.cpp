@@ -0,0 +1,165 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "TransportScript.h"
+
+
+using namespace juce;
+
+
+String TransportScript::readFromFile (const File& file, TransportScript& script)
+{
+    script = TransportScript();
+    
+    StringArray lines;
+    file.readLines (lines);
+    
+    if (lines.isEmpty())
+        return "cannot read the transport script " + file.getFullPathName();
+    
+    for (int i = 0 ; i < lines.size() ; i++) {
+        const StringArray tokens = StringArray::fromTokens (lines[i].upToFirstOccurrenceOf ("#", false, false), true);
+        if (tokens.isEmpty())
+            continue;
+        
+        const String error = file.getFileName() + ", line " + String (i+1) + ": ";
+        const String& name = tokens[0];
+        Command command { Command::play, 0.0, 0.0, 0.0 };
+        
+        if (name == "play" || name == "stop" || name == "preroll") {
+            if (tokens.size() != 2)
+                return error + name + " needs a duration";
+            
+            command.type = (name == "play") ? Command::play : (name == "stop") ? Command::stop : Command::preroll;
+            command.duration = tokens[1].getDoubleValue();
+        }
+        else if (name == "seek") {
+            if (tokens.size() != 2)
+                return error + "seek needs a position";
+            
+            command.type = Command::seek;
+            command.position = tokens[1].getDoubleValue();
+        }
+        else if (name == "loop") {
+            if (tokens.size() != 4)
+                return error + "loop needs a start, an end and a duration";
+            
+            command.type = Command::loop;
+            command.position = tokens[1].getDoubleValue();
+            command.loopEnd = tokens[2].getDoubleValue();
+            command.duration = tokens[3].getDoubleValue();
+            
+            if (command.loopEnd <= command.position)
+                return error + "the end of the loop must be after its start";
+        }
+        else {
+            return error + "unknown command " + name;
+        }
+        
+        if (command.duration < 0.0)
+            return error + "negative duration";
+        
+        script.commands.push_back (command);
+    }
+    
+    return {};
+}
+
+
+bool TransportScript::renderToWav (TempoMap& tempoMap, double sampleRate, int blockSize, bool sendSignalAlways, const File& file,
+                                   int numChannels, int bitsPerSample) const
+{
+    file.deleteFile();
+    std::unique_ptr<OutputStream> stream = file.createOutputStream();
+    if (stream == nullptr || blockSize <= 0)
+        return false;
+    
+    WavAudioFormat wavFormat;
+    std::unique_ptr<AudioFormatWriter> writer (wavFormat.createWriterFor (stream.get(), sampleRate, static_cast<unsigned int>(numChannels),
+                                                                          bitsPerSample, {}, 0));
+    if (writer == nullptr)
+        return false;
+    
+    stream.release(); // the writer owns it now
+    
+    
+    // what the host would do: prepareToPlay(), then one processBlock() after the other
+    SyncSignalRenderer signalRenderer (tempoMap);
+    signalRenderer.setSendSignalAlways (sendSignalAlways);
+    signalRenderer.prepare (sampleRate, blockSize);
+    
+    AudioBuffer<float> blockData (numChannels, blockSize);
+    
+    return render (signalRenderer, sampleRate, blockData, [&writer] (const AudioBuffer<float>& block, bool) {
+        return writer->writeFromAudioSampleBuffer (block, 0, block.getNumSamples());
+    });
+}
+
+
+bool TransportScript::render (SyncSignalRenderer& signalRenderer, double sampleRate, AudioBuffer<float>& blockData,
+                              const std::function<bool (const AudioBuffer<float>& block, bool isPlaying)>& blockRendered) const
+{
+    auto toSamples = [sampleRate] (double seconds) { return static_cast<int64_t> (std::llround (seconds * sampleRate)); };
+    const int blockSize = blockData.getNumSamples();
+    int64_t position = 0;
+    
+    for (const Command& command : commands) {
+        if (command.type == Command::seek) {
+            position = toSamples (command.position);
+            continue;
+        }
+        
+        if (command.type == Command::preroll)
+            position -= toSamples (command.duration);
+        
+        const bool isPlaying = (command.type != Command::stop);
+        const int64_t loopStart = toSamples (command.position);
+        const int64_t loopEnd = toSamples (command.loopEnd);
+        
+        for (int64_t remaining = toSamples (command.duration) ; remaining > 0 ; ) {
+            int numSamples = static_cast<int> (std::min (remaining, static_cast<int64_t> (blockSize)));
+            
+            if (command.type == Command::loop) {
+                if (position >= loopEnd)
+                    position = loopStart;
+                
+                numSamples = static_cast<int> (std::min (static_cast<int64_t> (numSamples), loopEnd - position));
+            }
+            
+            AudioBuffer<float> block (blockData.getArrayOfWritePointers(), blockData.getNumChannels(), numSamples); // no allocation, as in a host
+            signalRenderer.render (block, position, isPlaying);
+            
+            if (!blockRendered (block, isPlaying))
+                return false;
+            
+            if (isPlaying)
+                position += numSamples;
+            
+            remaining -= numSamples;
+        }
+    }
+    
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "../../Source/SyncSignalRenderer.h"
+
+
+// A scripted transport, to render the signal exactly as the playback renderer sends it while a host plays, stops, seeks and
+// loops, one block at a time. One command per line, times in seconds, '#' starts a comment:
+//     play <duration>                  plays from the current position
+//     stop <duration>                  stopped, the position does not move
+//     seek <position>                  moves the position (can be negative)
+//     preroll <duration>               moves the position back by duration, then plays until it gets back to it
+//     loop <start> <end> <duration>    plays, going back to start whenever end is reached
+// The position starts at 0.
+struct TransportScript
+{
+    struct Command {
+        enum Type { play, stop, seek, preroll, loop };
+        
+        Type type;
+        double position; // seek, loop start
+        double loopEnd;
+        double duration; // play, stop, preroll, loop
+    };
+    
+    std::vector<Command> commands;
+    
+    
+    // Returns an error message, or an empty string if the script can be used
+    static juce::String readFromFile (const juce::File& file, TransportScript& script);
+    
+    // Renders the whole script with blocks of blockSize samples (the last block of each command can be shorter, and a loop
+    // splits the block at its end like most hosts do) into a WAV file. tempoMap must already have its tick map at sampleRate.
+    bool renderToWav (TempoMap& tempoMap, double sampleRate, int blockSize, bool sendSignalAlways, const juce::File& file,
+                      int numChannels, int bitsPerSample) const;
+    
+    // The same, through a signal renderer already prepared for the size of blockData, which is used for every block.
+    // blockRendered is called after each block with the transport state, and stops the rendering when it returns false.
+    bool render (SyncSignalRenderer& signalRenderer, double sampleRate, juce::AudioBuffer<float>& blockData,
+                 const std::function<bool (const juce::AudioBuffer<float>& block, bool isPlaying)>& blockRendered) const;
+};
@@ -0,0 +1,558 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "HostCheck.h"
+#include "../../Source/PluginARADocumentController.h"
+#include "../../Source/SyncSignal.h"
+
+// the plugin settings (JucePlugin_Name, ARA factory and archive IDs...) are the ones Projucer generates for the plugin:
+// every exporter of MidroAudioSyncHostCheck.jucer force-includes ../JuceLibraryCode/JucePluginDefines.h
+#if ! defined (JucePlugin_ARADocumentArchiveID) || ! JucePlugin_Enable_ARA
+ #error "the plugin's JuceLibraryCode/JucePluginDefines.h must be force-included, see MidroAudioSyncHostCheck.jucer"
+#endif
+
+
+using namespace juce;
+
+
+// the ARA factory of the plugin (see PluginARADocumentController.cpp)
+const ARA::ARAFactory* JUCE_CALLTYPE createARAFactory();
+
+
+// the plugin calls this whenever we misuse the ARA API
+static std::atomic<int> numAraAsserts { 0 };
+
+static void ARA_CALL araAssert (ARA::ARAAssertCategory, const void*, const char* diagnosis)
+{
+    std::cerr << "ARA assert: " << diagnosis << "\n";
+    numAraAsserts++;
+}
+
+static ARA::ARAAssertFunction araAssertFunction = &araAssert;
+
+
+// The audio thread of the host: renders one block of every renderer after another, at speed times real time (the sample
+// rate of the first renderer), so that the edits of the model thread happen while they are playing
+class AudioThread : public Thread
+{
+public:
+    AudioThread (TestHost& host, double speed)
+        : Thread ("MidroAudioSync host check audio"),
+          _host (host),
+          _speed (speed)
+    {
+    }
+    
+    ~AudioThread() override
+    {
+        stopThread (-1);
+    }
+    
+    void run() override
+    {
+        const TestHost::Renderer& renderer = *_host.getRenderers().getFirst();
+        const double startTime = Time::getMillisecondCounterHiRes();
+        int64 numSamples = 0;
+        
+        while (!threadShouldExit()) {
+            _host.renderNextCycle();
+            numSamples = renderer.getBlocks().back().outputPosition + renderer.getBlocks().back().numSamples;
+            
+            const double nextCycleTime = startTime + 1000.0 * static_cast<double> (numSamples) / (renderer.getSampleRate() * _speed);
+            const double now = Time::getMillisecondCounterHiRes();
+            
+            if (nextCycleTime > now)
+                Thread::sleep (static_cast<int> (nextCycleTime - now));
+        }
+    }
+
+
+private:
+
+    TestHost& _host;
+    const double _speed;
+};
+
+
+
+
+int HostCheck::run (double sampleRate, int blockSize)
+{
+    const ARA::ARAFactory* factory = createARAFactory();
+    
+    ARA::ARAInterfaceConfiguration configuration {};
+    configuration.structSize = ARA_IMPLEMENTED_STRUCT_SIZE (ARA::ARAInterfaceConfiguration, assertFunctionAddress);
+    configuration.desiredApiGeneration = factory->highestSupportedApiGeneration;
+    configuration.assertFunctionAddress = &araAssertFunction;
+    factory->initializeARAWithConfiguration (&configuration);
+    
+    MemoryBlock archive;
+    int numFailures = checkEditsWhilePlaying (*factory, sampleRate, blockSize, archive);
+    
+    if (archive.getSize() > 0)
+        numFailures += checkRestore (*factory, sampleRate, blockSize, archive);
+    
+    factory->uninitializeARA();
+    
+    numFailures += report ("ARA API used as documented", numAraAsserts > 0 ? String (numAraAsserts.load()) + " ARA asserts" : String());
+    
+    return numFailures;
+}
+
+
+SongEvents HostCheck::makeSong (int editNumber)
+{
+    // (time in seconds, BPM): the tempo is constant from each time to the next one
+    std::vector<std::pair<double, double>> tempo { { 0.0, 120.0 } };
+    std::vector<TempoMap::BarSignature> barSignatures { { 4, 4, 0.0 } };
+    
+    if (editNumber >= 1)
+        tempo.push_back ({ 10.0, 97.0 });
+    
+    if (editNumber >= 2)
+        barSignatures = { { 4, 4, 0.0 }, { 7, 8, 16.0 }, { 3, 4, 30.0 }, { 5, 16, 39.0 }, { 4, 4, 41.5 } };
+    
+    if (editNumber >= 3) {
+        // a ramp made of many short constant tempos, as most DAWs give them
+        for (int step = 0 ; step < 400 ; step++)
+            tempo.push_back ({ 20.0 + step * (10.0 / 400.0), 97.0 + step * ((180.0 - 97.0) / 400.0) });
+        
+        tempo.push_back ({ 30.0, 180.0 });
+    }
+    
+    if (editNumber >= 4)
+        tempo.back().second = 140.0;
+    
+    if (editNumber >= 5) {
+        tempo.push_back ({ 35.0, 150.0 });
+        barSignatures.push_back ({ 5, 4, 70.0 });
+    }
+    
+    SongEvents song;
+    song.lengthInSeconds = songLengthInSeconds;
+    song.barSignatures = barSignatures;
+    
+    double quarter = 0.0;
+    for (size_t i = 0 ; i < tempo.size() ; i++) {
+        song.tempoEntries.push_back ({ tempo[i].first, quarter });
+        
+        const double end = (i + 1 < tempo.size()) ? tempo[i+1].first : songLengthInSeconds;
+        quarter += (end - tempo[i].first) * tempo[i].second / 60.0;
+    }
+    
+    song.tempoEntries.push_back ({ songLengthInSeconds, quarter });
+    
+    return song;
+}
+
+
+int HostCheck::checkEditsWhilePlaying (const ARA::ARAFactory& factory, double sampleRate, int blockSize, MemoryBlock& archive)
+{
+    int numFailures = 0;
+    
+    TestHost host (factory, makeSong (0));
+    
+    // two renderers at our sample rate, one in each precision, and one at another sample rate
+    const double otherSampleRate = (sampleRate != 44100.0) ? 44100.0 : 48000.0;
+    host.addRenderer (sampleRate, blockSize, false);
+    host.addRenderer (sampleRate, blockSize, true);
+    host.addRenderer (otherSampleRate, blockSize, false);
+    
+    const auto& renderers = host.getRenderers();
+    TickMapCache& tickMapCache = getTickMapCache (*renderers[0]);
+    const TickMapCache::RebuildStats& stats = tickMapCache.getRebuildStats();
+    
+    String error;
+    for (auto* renderer : renderers) {
+        if (&getTickMapCache (*renderer) != &tickMapCache)
+            error = "the renderers of the document do not share its TickMapCache";
+    }
+    numFailures += report ("one TickMapCache per document", error);
+    
+    if (!waitForRebuilds (tickMapCache))
+        return numFailures + report ("first tick maps", "not built after 10 s");
+    
+    numFailures += report ("one tick map per sample rate",
+                           stats.builtTickMaps != 2 ? String (stats.builtTickMaps.load()) + " tick maps built for 2 sample rates" : String());
+    
+    
+    // Each edit starts a new epoch: its first cycle is the first one which started after the tick maps were published, so
+    // the renderers took them at its start (the cycles in between can use the tick maps of either content)
+    struct Epoch {
+        SongEvents song;
+        int64 firstCycle;
+        int64 endCycle;
+        std::map<double, std::weak_ptr<const void>> tickMaps; // the ones of this content, which the next edit replaces
+    };
+    
+    std::vector<Epoch> epochs;
+    epochs.push_back ({ host.getContent(), 0, 0, {} });
+    
+    auto startEdit = [&] {
+        epochs.back().endCycle = host.getNumCyclesStarted() - 1; // the last cycle may have taken the new tick maps
+        epochs.back().tickMaps = tickMapCache.getTickMapReferences();
+    };
+    
+    auto endEdit = [&] (const String& check) {
+        if (!waitForRebuilds (tickMapCache)) {
+            numFailures += report (check, "tick maps not published after 10 s");
+            return false;
+        }
+        
+        epochs.push_back ({ host.getContent(), host.getNumCyclesStarted(), 0, {} });
+        return true;
+    };
+    
+    // every epoch lasts a few seconds of song, at 8 times real time
+    AudioThread audioThread (host, 8.0);
+    audioThread.startThread (Thread::Priority::highest);
+    Thread::sleep (400);
+    
+    
+    // one edit at a time: exactly one build per sample rate in use
+    for (int editNumber = 1 ; editNumber <= 3 ; editNumber++) {
+        const uint64_t completedBefore = stats.completedBuilds;
+        const uint64_t builtBefore = stats.builtTickMaps;
+        
+        startEdit();
+        host.setContent (makeSong (editNumber));
+        
+        const String check = "edit " + String (editNumber) + ": one build per sample rate";
+        if (!endEdit (check))
+            return numFailures;
+        
+        const uint64_t numCompleted = stats.completedBuilds - completedBefore;
+        const uint64_t numBuilt = stats.builtTickMaps - builtBefore;
+        numFailures += report (check, (numCompleted != 1 || numBuilt != 2) ? String (numCompleted) + " builds completed, "
+                                                                              + String (numBuilt) + " tick maps built" : String());
+        
+        Thread::sleep (400);
+    }
+    
+    
+    // a burst of edits, as when the user drags the tempo of the end of the song: the TickMapCache cannot keep up and must
+    // coalesce them, the last one is the one the renderers play
+    {
+        const uint64_t requestedBefore = stats.requestedBuilds;
+        const uint64_t completedBefore = stats.completedBuilds;
+        const uint64_t skippedBefore = stats.skippedBuilds;
+        constexpr int numBurstEdits = 100;
+        
+        startEdit();
+        
+        for (int i = 0 ; i < numBurstEdits - 1 ; i++) {
+            SongEvents song = makeSong (3);
+            song.tempoEntries.back().quarterPosition += i * 0.05;
+            host.setContent (song);
+        }
+        
+        host.setContent (makeSong (4));
+        
+        if (!endEdit ("edit 4: burst of edits coalesced"))
+            return numFailures;
+        
+        const uint64_t numRequested = stats.requestedBuilds - requestedBefore;
+        const uint64_t numCompleted = stats.completedBuilds - completedBefore;
+        const uint64_t numSkipped = stats.skippedBuilds - skippedBefore;
+        numFailures += report ("edit 4: burst of edits coalesced",
+                               (numRequested != numBurstEdits || numCompleted >= numRequested || numSkipped == 0)
+                                   ? String (numRequested) + " requests, " + String (numCompleted) + " builds completed, "
+                                     + String (numSkipped) + " skipped" : String());
+        
+        Thread::sleep (400);
+    }
+    
+    
+    // a long build (2 million tempo entries) replaced right away: it is skipped or cancelled, and the renderers get the
+    // tick maps of the edit which replaced it
+    {
+        const uint64_t skippedBefore = stats.skippedBuilds;
+        
+        SongEvents longSong = makeSong (4);
+        longSong.tempoEntries.clear();
+        
+        constexpr int numTempoEntries = 2000000;
+        double quarter = 0.0;
+        for (int i = 0 ; i < numTempoEntries ; i++) {
+            const double time = songLengthInSeconds * i / numTempoEntries;
+            longSong.tempoEntries.push_back ({ time, quarter });
+            quarter += (songLengthInSeconds / numTempoEntries) * (100.0 + 20.0 * sin (time)) / 60.0;
+        }
+        longSong.tempoEntries.push_back ({ songLengthInSeconds, quarter });
+        
+        startEdit();
+        host.setContent (longSong);
+        host.setContent (makeSong (5));
+        
+        if (!endEdit ("edit 5: long build replaced"))
+            return numFailures;
+        
+        numFailures += report ("edit 5: long build replaced", stats.skippedBuilds == skippedBefore ? "the long build was completed" : "");
+        
+        Thread::sleep (400);
+    }
+    
+    
+    // The same content again: nothing is built, but the TickMapCache publishes its tick maps again, which deletes the
+    // snapshots the audio threads gave back since the last edit. By then every tick map the renderers played before the
+    // last edit must be gone: the TempoMaps keep none of them, and the TickMapCache only keeps the ones in use.
+    {
+        const uint64_t unchangedBefore = stats.unchangedRequests;
+        
+        epochs.back().endCycle = host.getNumCyclesStarted();
+        host.setContent (host.getContent());
+        
+        if (!waitForRebuilds (tickMapCache))
+            return numFailures + report ("same content again", "request not handled after 10 s");
+        
+        numFailures += report ("same content again: nothing built", stats.unchangedRequests == unchangedBefore ? "the content was not seen as unchanged" : "");
+        
+        error.clear();
+        for (const auto& epoch : epochs) {
+            for (const auto& tickMap : epoch.tickMaps) {
+                if (!tickMap.second.expired())
+                    error = "the tick maps of " + (&epoch == &epochs.front() ? String ("the first content") : "an edit") + " are still alive";
+            }
+        }
+        numFailures += report ("replaced tick maps freed", error);
+        
+        // the TickMapCache and each TempoMap hold the tick map at their sample rate
+        error.clear();
+        for (const auto& tickMap : tickMapCache.getTickMapReferences()) {
+            const long numTempoMaps = (tickMap.first == sampleRate) ? 2 : 1;
+            
+            if (tickMap.second.use_count() != 1 + numTempoMaps)
+                error = "the renderers at " + String (tickMap.first) + " Hz do not share their tick map";
+        }
+        numFailures += report ("one tick map shared by the renderers at the same sample rate", error);
+    }
+    
+    audioThread.stopThread (-1);
+    
+    
+    // the signal of each content, from the first cycle at which the renderers had its tick maps to the next edit
+    for (size_t e = 0 ; e < epochs.size() ; e++) {
+        const Epoch& epoch = epochs[e];
+        const String check = (e == 0 ? String ("first content") : "edit " + String (e)) + ": pulses on the ticks of the content";
+        
+        error = (epoch.endCycle - epoch.firstCycle < 10) ? "the renderers did not play it" : String();
+        
+        for (int r = 0 ; r < renderers.size() && error.isEmpty() ; r++) {
+            error = checkPulses (*renderers[r], epoch.song, epoch.firstCycle, epoch.endCycle);
+            
+            if (error.isNotEmpty())
+                error = "renderer " + String (r) + " at " + String (renderers[r]->getSampleRate()) + " Hz: " + error;
+        }
+        
+        numFailures += report (check, error);
+    }
+    
+    error.clear();
+    for (auto* renderer : renderers) {
+        if (renderer->getNumDifferentSamples() > 0)
+            error = String (renderer->getNumDifferentSamples()) + " samples differ between the channels";
+    }
+    numFailures += report ("same signal on every channel", error);
+    
+    // the single and double precision renderers played exactly the same transport
+    const auto& singlePrecisionPulses = renderers[0]->getPulses();
+    const auto& doublePrecisionPulses = renderers[1]->getPulses();
+    error.clear();
+    
+    if (singlePrecisionPulses.size() != doublePrecisionPulses.size())
+        error = String (singlePrecisionPulses.size()) + " pulses in single precision, " + String (doublePrecisionPulses.size()) + " in double precision";
+    
+    for (size_t i = 0 ; i < singlePrecisionPulses.size() && error.isEmpty() ; i++) {
+        if (singlePrecisionPulses[i].outputPosition != doublePrecisionPulses[i].outputPosition)
+            error = "pulse " + String (i) + " is not at the same position";
+    }
+    numFailures += report ("same pulses in single and double precision", error);
+    
+    
+    numFailures += report ("document stored", host.storeDocument (archive) ? String() : "storeObjectsToArchive() failed");
+    
+    return numFailures;
+}
+
+
+int HostCheck::checkRestore (const ARA::ARAFactory& factory, double sampleRate, int blockSize, const MemoryBlock& archive)
+{
+    int numFailures = 0;
+    const auto numCycles = static_cast<int> (10.0 * sampleRate / blockSize);
+    
+    // the project is opened again as it was saved: the tick maps of the archive are used as they are
+    {
+        TestHost host (factory, makeSong (numEdits - 1));
+        numFailures += report ("document restored", host.restoreDocument (archive) ? String() : "restoreObjectsFromArchive() failed");
+        
+        const TestHost::Renderer& renderer = host.addRenderer (sampleRate, blockSize);
+        TickMapCache& tickMapCache = getTickMapCache (renderer);
+        const TickMapCache::RebuildStats& stats = tickMapCache.getRebuildStats();
+        
+        if (!waitForRebuilds (tickMapCache))
+            return numFailures + report ("same content: tick maps restored", "request not handled after 10 s");
+        
+        numFailures += report ("same content: tick maps restored", (stats.restoredTickMaps != 1 || stats.builtTickMaps != 0)
+                                   ? String (stats.restoredTickMaps.load()) + " tick maps restored, " + String (stats.builtTickMaps.load()) + " built"
+                                   : String());
+        
+        for (int i = 0 ; i < numCycles ; i++)
+            host.renderNextCycle();
+        
+        numFailures += report ("same content: pulses on the ticks of the content", checkPulses (renderer, host.getContent(), 0, numCycles));
+        
+        // the tick maps of the archive which were not needed are stored again (the other sample rate)
+        MemoryBlock storedAgain;
+        numFailures += report ("same content: archive stored again unchanged",
+                               !host.storeDocument (storedAgain) ? "storeObjectsToArchive() failed"
+                                   : storedAgain != archive ? "the archive is not the same" : String());
+    }
+    
+    // the content changed since the project was saved (e.g. another version of the host): the archive is ignored
+    {
+        TestHost host (factory, makeSong (0));
+        numFailures += report ("document restored", host.restoreDocument (archive) ? String() : "restoreObjectsFromArchive() failed");
+        
+        const TestHost::Renderer& renderer = host.addRenderer (sampleRate, blockSize);
+        TickMapCache& tickMapCache = getTickMapCache (renderer);
+        const TickMapCache::RebuildStats& stats = tickMapCache.getRebuildStats();
+        
+        if (!waitForRebuilds (tickMapCache))
+            return numFailures + report ("other content: tick maps built", "request not handled after 10 s");
+        
+        numFailures += report ("other content: tick maps built", (stats.restoredTickMaps != 0 || stats.builtTickMaps != 1)
+                                   ? String (stats.restoredTickMaps.load()) + " tick maps restored, " + String (stats.builtTickMaps.load()) + " built"
+                                   : String());
+        
+        for (int i = 0 ; i < numCycles ; i++)
+            host.renderNextCycle();
+        
+        numFailures += report ("other content: pulses on the ticks of the content", checkPulses (renderer, host.getContent(), 0, numCycles));
+    }
+    
+    return numFailures;
+}
+
+
+TickMapCache& HostCheck::getTickMapCache (const TestHost::Renderer& renderer)
+{
+    auto* documentController = renderer.getPlaybackRenderer()->getDocumentController();
+    return ARADocumentControllerSpecialisation::getSpecialisedDocumentController<MidroAudioSyncDocumentController> (documentController)->getTickMapCache();
+}
+
+
+bool HostCheck::waitForRebuilds (TickMapCache& tickMapCache, int timeoutMs)
+{
+    const TickMapCache::RebuildStats& stats = tickMapCache.getRebuildStats();
+    const double timeout = Time::getMillisecondCounterHiRes() + timeoutMs;
+    
+    // every request is either completed, skipped (replaced or cancelled) or found unchanged
+    const uint64_t numRequested = stats.requestedBuilds;
+    
+    while (stats.completedBuilds + stats.skippedBuilds + stats.unchangedRequests < numRequested) {
+        if (Time::getMillisecondCounterHiRes() > timeout)
+            return false;
+        
+        Thread::sleep (1);
+    }
+    
+    return true;
+}
+
+
+String HostCheck::checkPulses (const TestHost::Renderer& renderer, const SongEvents& song, int64 firstCycle, int64 endCycle)
+{
+    const double sampleRate = renderer.getSampleRate();
+    const auto loopEnd = static_cast<int64> (ceil (song.lengthInSeconds * sampleRate));
+    const auto minSamplesBetweenTicks = static_cast<int64> (ceil (SyncSignal::minTickLengthInSeconds * sampleRate));
+    
+    auto toTime = [sampleRate] (int64 position) { return String (static_cast<double> (position) / sampleRate, 6) + " s"; };
+    
+    // the ticks of the content, from a tick map built directly from its events
+    TempoMap tempoMap (song.tempoEntries, song.barSignatures, sampleRate);
+    std::vector<TempoMap::Tick> ticks;
+    
+    {
+        constexpr int chunkSize = 4096;
+        std::vector<TempoMap::Tick> chunk (chunkSize + 1); // at most one tick per sample
+        TempoMap::Tick firstTickAfterChunk;
+        
+        for (int64 start = 0 ; start < loopEnd ; start += chunkSize) {
+            const int numTicks = tempoMap.getTicksInBlock (start, jmin (start + chunkSize, loopEnd), chunk.data(), static_cast<int> (chunk.size()), firstTickAfterChunk);
+            ticks.insert (ticks.end(), chunk.begin(), chunk.begin() + numTicks);
+        }
+    }
+    
+    const auto& pulses = renderer.getPulses();
+    const float barTickThreshold = 0.5f * (SyncSignal::tickHeight + SyncSignal::barTickHeight); // the peak of the high ticks is barTickHeight
+    
+    auto findTick = [&ticks] (int64 position) {
+        return std::lower_bound (ticks.begin(), ticks.end(), position, [] (const TempoMap::Tick& tick, int64 p) { return tick.position < p; });
+    };
+    
+    // every pulse is on a tick, with the right height
+    for (const auto& pulse : pulses) {
+        if (pulse.cycle < firstCycle || pulse.cycle >= endCycle)
+            continue;
+        
+        const auto tick = findTick (pulse.timelinePosition);
+        
+        if (tick == ticks.end() || tick->position != pulse.timelinePosition)
+            return "pulse at " + toTime (pulse.timelinePosition) + " is not on a tick";
+        
+        if (tick->lastTickRightBeforeABar != (pulse.peak > barTickThreshold))
+            return "pulse at " + toTime (pulse.timelinePosition) + (tick->lastTickRightBeforeABar ? " should" : " should not") + " be a bar tick";
+    }
+    
+    // every tick has its pulse, unless it comes too soon after the previous one (right after the end of the loop)
+    for (const auto& block : renderer.getBlocks()) {
+        if (block.cycle < firstCycle || block.cycle >= endCycle)
+            continue;
+        
+        for (auto tick = findTick (block.timelinePosition) ; tick != ticks.end() && tick->position < block.timelinePosition + block.numSamples ; tick++) {
+            const int64 outputPosition = block.outputPosition + (tick->position - block.timelinePosition);
+            
+            const auto pulse = std::lower_bound (pulses.begin(), pulses.end(), outputPosition,
+                                                 [] (const TestHost::Renderer::Pulse& p, int64 o) { return p.outputPosition < o; });
+            
+            if (pulse != pulses.end() && pulse->outputPosition == outputPosition)
+                continue;
+            
+            if (pulse != pulses.begin() && outputPosition - std::prev (pulse)->outputPosition < minSamplesBetweenTicks)
+                continue;
+            
+            return "tick at " + toTime (tick->position) + " was not sent";
+        }
+    }
+    
+    return {};
+}
+
+
+int HostCheck::report (const String& check, const String& error)
+{
+    std::cout << (error.isEmpty() ? "ok      " : "FAILED  ") << check << (error.isEmpty() ? String() : ": " + error) << "\n";
+    return error.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "TestHost.h"
+#include "../../Source/TickMapCache.h"
+
+
+// Checks the plugin as a DAW drives it, through the ARA API (see TestHost), which the sync file generator cannot do:
+// - edits of the tempo and bar signature content while the renderers are playing: after each edit, as soon as the
+//   TickMapCache has published its tick maps, every pulse of every renderer must be on a tick of the new content (a tick
+//   map built directly from its events), with the right bar ticks, and every tick must have its pulse
+// - the renderers of a document share its TickMapCache: one build per sample rate in use, the same tick map for all the
+//   renderers at the same sample rate, in single and double precision
+// - a burst of edits is coalesced: fewer builds than edits, the builds of replaced edits are skipped or cancelled, and the
+//   last edit always wins, even when it comes while a long build is running
+// - the tick maps replaced on the audio threads (the _newTickMap/_oldTickMaps handoff of TempoMap) are all freed
+// - the tick maps stored in the ARA archive are used as they are when the document is restored with the same content
+//   (stored again byte for byte), and ignored when its content changed
+// Each check prints a line, a failure says what went wrong.
+struct HostCheck
+{
+    // Returns the number of failed checks
+    static int run (double sampleRate, int blockSize);
+
+
+private:
+
+    // the song used by every check, with the tempo and bar signature content of edit number editNumber (0 for the first one)
+    static SongEvents makeSong (int editNumber);
+    
+    static constexpr double songLengthInSeconds = 40.0;
+    static constexpr int numEdits = 6; // see makeSong()
+    
+    static int checkEditsWhilePlaying (const ARA::ARAFactory& factory, double sampleRate, int blockSize, juce::MemoryBlock& archive);
+    static int checkRestore (const ARA::ARAFactory& factory, double sampleRate, int blockSize, const juce::MemoryBlock& archive);
+    
+    
+    // the TickMapCache of the document of renderer, which the plugin created for it
+    static TickMapCache& getTickMapCache (const TestHost::Renderer& renderer);
+    
+    // waits until the TickMapCache thread has dealt with every request made so far, returns false after timeoutMs
+    static bool waitForRebuilds (TickMapCache& tickMapCache, int timeoutMs = 10000);
+    
+    // Compares the pulses of renderer in the blocks of cycles [firstCycle, endCycle) to the ticks of song, returns a
+    // description of the first problem found, or an empty string
+    static juce::String checkPulses (const TestHost::Renderer& renderer, const SongEvents& song, juce::int64 firstCycle, juce::int64 endCycle);
+    
+    // prints the result of a check, and returns 1 if it failed
+    static int report (const juce::String& check, const juce::String& error);
+};
@@ -0,0 +1,73 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "HostCheck.h"
+
+
+using namespace juce;
+
+
+static void printUsage()
+{
+    std::cout << "Checks the MidroAudioSync plugin through the ARA API, as a DAW drives it (see HostCheck.h).\n\n"
+              << "usage: MidroAudioSyncHostCheck [options]\n\n"
+              << "options:\n"
+              << "    --samplerate=<Hz>      of the renderers, default 48000 (one of them always runs at another sample rate)\n"
+              << "    --blocksize=<n>        default 512\n";
+}
+
+
+int main (int argc, char* argv[])
+{
+    double sampleRate = 48000.0;
+    int blockSize = 512;
+    
+    for (int i = 1 ; i < argc ; i++) {
+        const String arg (CharPointer_UTF8 (argv[i]));
+        const String value = arg.fromFirstOccurrenceOf ("=", false, false);
+        
+        if (arg.startsWith ("--samplerate="))   sampleRate = value.getDoubleValue();
+        else if (arg.startsWith ("--blocksize=")) blockSize = value.getIntValue();
+        else {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+    
+    if (sampleRate <= 0.0 || blockSize <= 0) {
+        printUsage();
+        return 1;
+    }
+    
+    // the main thread is the message thread, where DAWs edit their ARA documents
+    const ScopedJuceInitialiser_GUI juceInitialiser;
+    
+    const int numFailures = HostCheck::run (sampleRate, blockSize);
+    std::cout << (numFailures == 0 ? "all checks passed" : String (numFailures) + " checks failed") << "\n";
+    
+    return numFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "TestHost.h"
+#include "../../Source/SyncSignal.h"
+
+
+using namespace juce;
+
+
+// the plugin, as its wrappers create it (see PluginProcessor.cpp and PluginARADocumentController.cpp)
+AudioProcessor* JUCE_CALLTYPE createPluginFilter();
+
+
+TestHost::TestHost (const ARA::ARAFactory& factory, const SongEvents& song)
+    : _factory (factory),
+      _hostInstance (this, this, this) // no model update nor playback controller, the plugin does not need them
+{
+    ARA::ARADocumentProperties documentProperties {};
+    documentProperties.structSize = ARA_IMPLEMENTED_STRUCT_SIZE (ARA::ARADocumentProperties, name);
+    documentProperties.name = "MidroAudioSync host check";
+    
+    _documentControllerInstance = _factory.createDocumentControllerWithDocument (&_hostInstance, &documentProperties);
+    jassert (_documentControllerInstance != nullptr);
+    _documentController = std::make_unique<ARA::Host::DocumentController> (_documentControllerInstance);
+    
+    _song = song;
+    
+    for (const auto& tempoEntry : _song.tempoEntries)
+        _tempoEntries.push_back ({ tempoEntry.timePosition, tempoEntry.quarterPosition });
+    
+    for (const auto& barSignature : _song.barSignatures)
+        _barSignatures.push_back ({ barSignature.numerator, barSignature.denominator, barSignature.position });
+    
+    
+    // the same model graph as a DAW with one track and one clip on it
+    _documentController->beginEditing();
+    
+    ARA::ARAMusicalContextProperties musicalContextProperties {};
+    musicalContextProperties.structSize = ARA_IMPLEMENTED_STRUCT_SIZE (ARA::ARAMusicalContextProperties, color);
+    musicalContextProperties.name = "Song";
+    _musicalContextRef = _documentController->createMusicalContext (reinterpret_cast<ARA::ARAMusicalContextHostRef> (this), &musicalContextProperties);
+    
+    ARA::ARARegionSequenceProperties regionSequenceProperties {};
+    regionSequenceProperties.structSize = ARA_IMPLEMENTED_STRUCT_SIZE (ARA::ARARegionSequenceProperties, color);
+    regionSequenceProperties.name = "Track";
+    regionSequenceProperties.musicalContextRef = _musicalContextRef;
+    _regionSequenceRef = _documentController->createRegionSequence (reinterpret_cast<ARA::ARARegionSequenceHostRef> (this), &regionSequenceProperties);
+    
+    ARA::ARAAudioSourceProperties audioSourceProperties {};
+    audioSourceProperties.structSize = ARA_IMPLEMENTED_STRUCT_SIZE (ARA::ARAAudioSourceProperties, merits64BitSamples);
+    audioSourceProperties.name = "Clip";
+    audioSourceProperties.persistentID = "audioSource";
+    audioSourceProperties.sampleRate = 48000.0;
+    audioSourceProperties.sampleCount = static_cast<ARA::ARASampleCount> (ceil (_song.lengthInSeconds * audioSourceProperties.sampleRate));
+    audioSourceProperties.channelCount = 1;
+    _audioSourceRef = _documentController->createAudioSource (reinterpret_cast<ARA::ARAAudioSourceHostRef> (this), &audioSourceProperties);
+    
+    ARA::ARAAudioModificationProperties audioModificationProperties {};
+    audioModificationProperties.structSize = ARA_IMPLEMENTED_STRUCT_SIZE (ARA::ARAAudioModificationProperties, persistentID);
+    audioModificationProperties.name = "Clip";
+    audioModificationProperties.persistentID = "audioModification";
+    _audioModificationRef = _documentController->createAudioModification (_audioSourceRef, reinterpret_cast<ARA::ARAAudioModificationHostRef> (this),
+                                                                          &audioModificationProperties);
+    
+    ARA::ARAPlaybackRegionProperties playbackRegionProperties {};
+    playbackRegionProperties.structSize = ARA_IMPLEMENTED_STRUCT_SIZE (ARA::ARAPlaybackRegionProperties, color);
+    playbackRegionProperties.transformationFlags = ARA::kARAPlaybackTransformationNoChanges;
+    playbackRegionProperties.durationInModificationTime = _song.lengthInSeconds;
+    playbackRegionProperties.durationInPlaybackTime = _song.lengthInSeconds;
+    playbackRegionProperties.musicalContextRef = _musicalContextRef;
+    playbackRegionProperties.regionSequenceRef = _regionSequenceRef;
+    playbackRegionProperties.name = "Clip";
+    _playbackRegionRef = _documentController->createPlaybackRegion (_audioModificationRef, reinterpret_cast<ARA::ARAPlaybackRegionHostRef> (this),
+                                                                    &playbackRegionProperties);
+    
+    _documentController->endEditing();
+}
+
+TestHost::~TestHost()
+{
+    // the plugin instances go first, as when a DAW closes a project
+    _renderers.clear();
+    
+    _documentController->beginEditing();
+    _documentController->destroyPlaybackRegion (_playbackRegionRef);
+    _documentController->destroyAudioModification (_audioModificationRef);
+    _documentController->destroyAudioSource (_audioSourceRef);
+    _documentController->destroyRegionSequence (_regionSequenceRef);
+    _documentController->destroyMusicalContext (_musicalContextRef);
+    _documentController->endEditing();
+    
+    _documentController->destroyDocumentController();
+}
+
+
+void TestHost::setContent (const SongEvents& song)
+{
+    jassert (song.lengthInSeconds == _song.lengthInSeconds); // the playback region and the transports do not change
+    
+    _documentController->beginEditing();
+    
+    _song = song;
+    
+    _tempoEntries.clear();
+    for (const auto& tempoEntry : _song.tempoEntries)
+        _tempoEntries.push_back ({ tempoEntry.timePosition, tempoEntry.quarterPosition });
+    
+    _barSignatures.clear();
+    for (const auto& barSignature : _song.barSignatures)
+        _barSignatures.push_back ({ barSignature.numerator, barSignature.denominator, barSignature.position });
+    
+    _documentController->updateMusicalContextContent (_musicalContextRef, nullptr, ARA::kARAContentUpdateEverythingChanged);
+    _documentController->endEditing();
+}
+
+
+bool TestHost::storeDocument (MemoryBlock& archive)
+{
+    archive.reset();
+    return _documentController->storeObjectsToArchive (reinterpret_cast<ARA::ARAArchiveWriterHostRef> (&archive), nullptr);
+}
+
+bool TestHost::restoreDocument (const MemoryBlock& archive)
+{
+    jassert (_renderers.isEmpty());
+    
+    _documentController->beginEditing();
+    const bool restored = _documentController->restoreObjectsFromArchive (reinterpret_cast<ARA::ARAArchiveReaderHostRef> (const_cast<MemoryBlock*> (&archive)), nullptr);
+    _documentController->endEditing();
+    
+    return restored;
+}
+
+
+TestHost::Renderer& TestHost::addRenderer (double sampleRate, int maximumBlockSize, bool doublePrecision)
+{
+    return *_renderers.add (new Renderer (*this, sampleRate, maximumBlockSize, doublePrecision));
+}
+
+void TestHost::renderNextCycle()
+{
+    const int64 cycle = _numCyclesStarted++;
+    
+    for (auto* renderer : _renderers)
+        renderer->renderNextBlock (cycle);
+}
+
+
+
+
+ARA::ARASize TestHost::getArchiveSize (ARA::ARAArchiveReaderHostRef archiveReaderHostRef) noexcept
+{
+    return reinterpret_cast<const MemoryBlock*> (archiveReaderHostRef)->getSize();
+}
+
+bool TestHost::readBytesFromArchive (ARA::ARAArchiveReaderHostRef archiveReaderHostRef, ARA::ARASize position, ARA::ARASize length, ARA::ARAByte buffer[]) noexcept
+{
+    const auto* archive = reinterpret_cast<const MemoryBlock*> (archiveReaderHostRef);
+    
+    if (position + length > archive->getSize())
+        return false;
+    
+    archive->copyTo (buffer, static_cast<int> (position), length);
+    return true;
+}
+
+bool TestHost::writeBytesToArchive (ARA::ARAArchiveWriterHostRef archiveWriterHostRef, ARA::ARASize position, ARA::ARASize length, const ARA::ARAByte buffer[]) noexcept
+{
+    auto* archive = reinterpret_cast<MemoryBlock*> (archiveWriterHostRef);
+    
+    if (archive->getSize() < position + length)
+        archive->setSize (position + length, true);
+    
+    archive->copyFrom (buffer, static_cast<int> (position), length);
+    return true;
+}
+
+
+bool TestHost::isMusicalContextContentAvailable (ARA::ARAMusicalContextHostRef, ARA::ARAContentType type) noexcept
+{
+    return type == ARA::kARAContentTypeTempoEntries || type == ARA::kARAContentTypeBarSignatures;
+}
+
+ARA::ARAContentReaderHostRef TestHost::createMusicalContextContentReader (ARA::ARAMusicalContextHostRef, const ARA::ARAContentTimeRange*, ARA::ARAContentType type) noexcept
+{
+    if (!isMusicalContextContentAvailable (nullptr, type))
+        return nullptr;
+    
+    return reinterpret_cast<ARA::ARAContentReaderHostRef> (new ARA::ARAContentType (type));
+}
+
+ARA::ARAInt32 TestHost::getContentReaderEventCount (ARA::ARAContentReaderHostRef contentReaderHostRef) noexcept
+{
+    const auto type = *reinterpret_cast<const ARA::ARAContentType*> (contentReaderHostRef);
+    const size_t count = (type == ARA::kARAContentTypeTempoEntries) ? _tempoEntries.size() : _barSignatures.size();
+    
+    return static_cast<ARA::ARAInt32> (count);
+}
+
+const void* TestHost::getContentReaderDataForEvent (ARA::ARAContentReaderHostRef contentReaderHostRef, ARA::ARAInt32 eventIndex) noexcept
+{
+    const auto type = *reinterpret_cast<const ARA::ARAContentType*> (contentReaderHostRef);
+    
+    if (type == ARA::kARAContentTypeTempoEntries)
+        return &_tempoEntries[static_cast<size_t> (eventIndex)];
+    
+    return &_barSignatures[static_cast<size_t> (eventIndex)];
+}
+
+void TestHost::destroyContentReader (ARA::ARAContentReaderHostRef contentReaderHostRef) noexcept
+{
+    delete reinterpret_cast<ARA::ARAContentType*> (contentReaderHostRef);
+}
+
+
+
+
+TestHost::Renderer::Renderer (TestHost& host, double sampleRate, int maximumBlockSize, bool doublePrecision)
+    : _host (host),
+      _sampleRate (sampleRate),
+      _maximumBlockSize (maximumBlockSize),
+      _doublePrecision (doublePrecision),
+      _loopEnd (static_cast<int64> (ceil (host._song.lengthInSeconds * sampleRate)))
+{
+    _processor.reset (createPluginFilter());
+    
+    // what the VST3 and AU wrappers do when the host binds a plugin instance to a document
+    auto* araExtension = dynamic_cast<AudioProcessorARAExtension*> (_processor.get());
+    jassert (araExtension != nullptr);
+    
+    const ARA::ARAPlugInInstanceRoleFlags knownRoles = ARA::kARAPlaybackRendererRole | ARA::kARAEditorRendererRole | ARA::kARAEditorViewRole;
+    const ARA::ARAPlugInExtensionInstance* extensionInstance = araExtension->bindToARA (_host._documentControllerInstance->documentControllerRef,
+                                                                                        knownRoles, ARA::kARAPlaybackRendererRole);
+    
+    _araPlaybackRenderer = std::make_unique<ARA::Host::PlaybackRenderer> (extensionInstance);
+    _araPlaybackRenderer->addPlaybackRegion (_host._playbackRegionRef);
+    
+    _processor->setProcessingPrecision (doublePrecision ? AudioProcessor::doublePrecision : AudioProcessor::singlePrecision);
+    _processor->setPlayConfigDetails (2, 2, sampleRate, maximumBlockSize);
+    _processor->setPlayHead (&_playHead);
+    _processor->prepareToPlay (sampleRate, maximumBlockSize); // waits for the tick map at our sample rate
+    
+    _floatBuffer.setSize (2, maximumBlockSize);
+    _doubleBuffer.setSize (2, maximumBlockSize);
+    
+    // enough for a few minutes of transport, the audio thread should not allocate
+    const size_t numBlocks = static_cast<size_t> (600.0 * sampleRate) / static_cast<size_t> (maximumBlockSize);
+    _blocks.reserve (numBlocks);
+    _pulses.reserve (static_cast<size_t> (600.0 / SyncSignal::minTickLengthInSeconds));
+}
+
+TestHost::Renderer::~Renderer()
+{
+    _processor->releaseResources();
+    _araPlaybackRenderer->removePlaybackRegion (_host._playbackRegionRef);
+    _processor.reset(); // also destroys the playback renderer of the plugin
+}
+
+
+ARAPlaybackRenderer* TestHost::Renderer::getPlaybackRenderer() const
+{
+    return dynamic_cast<AudioProcessorARAExtension*> (_processor.get())->getPlaybackRenderer();
+}
+
+
+void TestHost::Renderer::renderNextBlock (int64 cycle)
+{
+    // like most hosts, the block is cut at the end of the loop
+    const int numSamples = static_cast<int> (jmin (static_cast<int64> (_maximumBlockSize), _loopEnd - _timelinePosition));
+    
+    _playHead.positionInfo.setTimeInSamples (_timelinePosition);
+    _playHead.positionInfo.setTimeInSeconds (static_cast<double> (_timelinePosition) / _sampleRate);
+    _playHead.positionInfo.setIsPlaying (true);
+    _playHead.positionInfo.setIsLooping (true);
+    
+    _blocks.push_back ({ cycle, _outputPosition, _timelinePosition, numSamples });
+    
+    if (_doublePrecision) {
+        _doubleBuffer.setSize (2, numSamples, false, false, true);
+        _processor->processBlock (_doubleBuffer, _midiBuffer);
+        findPulses (_doubleBuffer, cycle);
+    }
+    else {
+        _floatBuffer.setSize (2, numSamples, false, false, true);
+        _processor->processBlock (_floatBuffer, _midiBuffer);
+        findPulses (_floatBuffer, cycle);
+    }
+    
+    _outputPosition += numSamples;
+    _timelinePosition += numSamples;
+    
+    if (_timelinePosition == _loopEnd)
+        _timelinePosition = 0;
+}
+
+
+template <typename SampleType>
+void TestHost::Renderer::findPulses (const AudioBuffer<SampleType>& buffer, int64 cycle)
+{
+    const SampleType* left = buffer.getReadPointer (0);
+    const SampleType* right = buffer.getReadPointer (1);
+    
+    for (int i = 0 ; i < buffer.getNumSamples() ; i++) {
+        if (right[i] != left[i])
+            _numDifferentSamples++;
+        
+        const auto sample = static_cast<float> (left[i]);
+        
+        if (sample == 0.0f) {
+            _inPulse = false;
+            continue;
+        }
+        
+        if (!_inPulse)
+            _pulses.push_back ({ cycle, _outputPosition + i, _timelinePosition + i, 0.0f });
+        
+        _inPulse = true;
+        _pulses.back().peak = jmax (_pulses.back().peak, std::abs (sample));
+    }
+}
@@ -0,0 +1,199 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <ARA_Library/Dispatch/ARAHostDispatch.h>
+
+#include "../../Generator/Source/SongEvents.h"
+
+
+// A minimal ARA host around the plugin: one document with one musical context (whose tempo and bar signature content can
+// be changed at any time, as when the user edits the tempo track of a DAW), one audio source and one playback region
+// covering the whole song. Playback renderers are plugin instances bound to the document, each playing the song in a loop
+// from its own transport, and recording the pulses of the signal it gets back.
+// Everything goes through the ARA API, exactly as in a DAW: the plugin only sees the document controller created by its
+// ARA factory, the content readers and the archive readers/writers given here.
+class TestHost : private ARA::Host::AudioAccessControllerInterface,
+                 private ARA::Host::ArchivingControllerInterface,
+                 private ARA::Host::ContentAccessControllerInterface
+{
+public:
+    // factory must already be initialized (ARAFactory::initializeARAWithConfiguration())
+    TestHost (const ARA::ARAFactory& factory, const SongEvents& song);
+    
+    ~TestHost();
+    
+    
+    // Model thread: replaces the tempo entries and bar signatures of the musical context, in one edit cycle
+    void setContent (const SongEvents& song);
+    
+    const SongEvents& getContent() const { return _song; }
+    
+    
+    // the archive of the whole document, as when the project is saved
+    bool storeDocument (juce::MemoryBlock& archive);
+    
+    // as when the project is opened: to be called before adding any renderer
+    bool restoreDocument (const juce::MemoryBlock& archive);
+    
+    
+    class Renderer
+    {
+    public:
+        // a pulse of the signal: a run of non-zero samples
+        struct Pulse {
+            juce::int64 cycle; // see TestHost::renderNextCycle()
+            juce::int64 outputPosition; // in the rendered signal
+            juce::int64 timelinePosition; // in the song, where the transport was when the pulse started
+            float peak;
+        };
+        
+        struct Block {
+            juce::int64 cycle;
+            juce::int64 outputPosition;
+            juce::int64 timelinePosition;
+            int numSamples;
+        };
+        
+        ~Renderer();
+        
+        double getSampleRate() const { return _sampleRate; }
+        const std::vector<Pulse>& getPulses() const { return _pulses; }
+        const std::vector<Block>& getBlocks() const { return _blocks; }
+        juce::int64 getNumDifferentSamples() const { return _numDifferentSamples; } // between the 2 channels, which should be the same
+        
+        // the playback renderer the plugin created for this instance
+        juce::ARAPlaybackRenderer* getPlaybackRenderer() const;
+    
+    
+    private:
+        
+        friend class TestHost;
+        
+        Renderer (TestHost& host, double sampleRate, int maximumBlockSize, bool doublePrecision);
+        
+        // Audio thread: renders the next block of the transport, which plays the song in a loop
+        void renderNextBlock (juce::int64 cycle);
+        
+        template <typename SampleType>
+        void findPulses (const juce::AudioBuffer<SampleType>& buffer, juce::int64 cycle);
+        
+        
+        struct PlayHead : public juce::AudioPlayHead {
+            juce::Optional<PositionInfo> getPosition() const override { return positionInfo; }
+            PositionInfo positionInfo;
+        };
+        
+        TestHost& _host;
+        const double _sampleRate;
+        const int _maximumBlockSize;
+        const bool _doublePrecision;
+        const juce::int64 _loopEnd; // the end of the song, where the transport goes back to its start
+        
+        std::unique_ptr<juce::AudioProcessor> _processor;
+        std::unique_ptr<ARA::Host::PlaybackRenderer> _araPlaybackRenderer;
+        PlayHead _playHead;
+        
+        juce::AudioBuffer<float> _floatBuffer;
+        juce::AudioBuffer<double> _doubleBuffer;
+        juce::MidiBuffer _midiBuffer;
+        
+        juce::int64 _outputPosition = 0;
+        juce::int64 _timelinePosition = 0;
+        
+        std::vector<Pulse> _pulses;
+        std::vector<Block> _blocks;
+        bool _inPulse = false;
+        juce::int64 _numDifferentSamples = 0;
+        
+        JUCE_DECLARE_NON_COPYABLE (Renderer)
+    };
+    
+    // Creates a plugin instance, binds it to the document as the playback renderer of our playback region, and prepares it.
+    // The renderers belong to the host, they are destroyed (before the document) with it.
+    Renderer& addRenderer (double sampleRate, int maximumBlockSize, bool doublePrecision = false);
+    
+    // Audio thread: one block of every renderer. Cycles are numbered from 0 in the order they start, so that the model
+    // thread can tell which blocks started after an edit (see getNumCyclesStarted())
+    void renderNextCycle();
+    
+    juce::int64 getNumCyclesStarted() const { return _numCyclesStarted.load(); }
+    
+    const juce::OwnedArray<Renderer>& getRenderers() const { return _renderers; }
+
+
+private:
+
+    // AudioAccessControllerInterface: the plugin never reads the audio of our audio source
+    ARA::ARAAudioReaderHostRef createAudioReaderForSource (ARA::ARAAudioSourceHostRef, bool) noexcept override { return nullptr; }
+    bool readAudioSamples (ARA::ARAAudioReaderHostRef, ARA::ARASamplePosition, ARA::ARASampleCount, void* const[]) noexcept override { return false; }
+    void destroyAudioReader (ARA::ARAAudioReaderHostRef) noexcept override {}
+    
+    // ArchivingControllerInterface: the archive readers and writers are juce::MemoryBlocks
+    ARA::ARASize getArchiveSize (ARA::ARAArchiveReaderHostRef archiveReaderHostRef) noexcept override;
+    bool readBytesFromArchive (ARA::ARAArchiveReaderHostRef archiveReaderHostRef, ARA::ARASize position, ARA::ARASize length, ARA::ARAByte buffer[]) noexcept override;
+    bool writeBytesToArchive (ARA::ARAArchiveWriterHostRef archiveWriterHostRef, ARA::ARASize position, ARA::ARASize length, const ARA::ARAByte buffer[]) noexcept override;
+    void notifyDocumentArchivingProgress (float) noexcept override {}
+    void notifyDocumentUnarchivingProgress (float) noexcept override {}
+    ARA::ARAPersistentID getDocumentArchiveID (ARA::ARAArchiveReaderHostRef) noexcept override { return _factory.documentArchiveID; }
+    
+    // ContentAccessControllerInterface: the tempo entries and bar signatures of our musical context, nothing for the audio source
+    bool isMusicalContextContentAvailable (ARA::ARAMusicalContextHostRef, ARA::ARAContentType type) noexcept override;
+    ARA::ARAContentGrade getMusicalContextContentGrade (ARA::ARAMusicalContextHostRef, ARA::ARAContentType) noexcept override { return ARA::kARAContentGradeAdjusted; }
+    ARA::ARAContentReaderHostRef createMusicalContextContentReader (ARA::ARAMusicalContextHostRef, const ARA::ARAContentTimeRange*, ARA::ARAContentType type) noexcept override;
+    bool isAudioSourceContentAvailable (ARA::ARAAudioSourceHostRef, ARA::ARAContentType) noexcept override { return false; }
+    ARA::ARAContentGrade getAudioSourceContentGrade (ARA::ARAAudioSourceHostRef, ARA::ARAContentType) noexcept override { return ARA::kARAContentGradeInitial; }
+    ARA::ARAContentReaderHostRef createAudioSourceContentReader (ARA::ARAAudioSourceHostRef, const ARA::ARAContentTimeRange*, ARA::ARAContentType) noexcept override { return nullptr; }
+    ARA::ARAInt32 getContentReaderEventCount (ARA::ARAContentReaderHostRef contentReaderHostRef) noexcept override;
+    const void* getContentReaderDataForEvent (ARA::ARAContentReaderHostRef contentReaderHostRef, ARA::ARAInt32 eventIndex) noexcept override;
+    void destroyContentReader (ARA::ARAContentReaderHostRef contentReaderHostRef) noexcept override;
+    
+    
+    const ARA::ARAFactory& _factory;
+    
+    SongEvents _song;
+    
+    // the content as the plugin reads it: a content reader is a pointer to the ARAContentType it reads, the events do not
+    // change while it exists (the plugin reads them during our own calls to the document controller)
+    std::vector<ARA::ARAContentTempoEntry> _tempoEntries;
+    std::vector<ARA::ARAContentBarSignature> _barSignatures;
+    
+    ARA::Host::DocumentControllerHostInstance _hostInstance;
+    const ARA::ARADocumentControllerInstance* _documentControllerInstance = nullptr;
+    std::unique_ptr<ARA::Host::DocumentController> _documentController;
+    
+    ARA::ARAMusicalContextRef _musicalContextRef = nullptr;
+    ARA::ARARegionSequenceRef _regionSequenceRef = nullptr;
+    ARA::ARAAudioSourceRef _audioSourceRef = nullptr;
+    ARA::ARAAudioModificationRef _audioModificationRef = nullptr;
+    ARA::ARAPlaybackRegionRef _playbackRegionRef = nullptr;
+    
+    juce::OwnedArray<Renderer> _renderers;
+    std::atomic<juce::int64> _numCyclesStarted { 0 };
+    
+    JUCE_DECLARE_NON_COPYABLE (TestHost)
+};
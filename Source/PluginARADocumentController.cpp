@@ -29,19 +29,29 @@
 using namespace juce;
 
 
+TickMapCache& MidroAudioSyncDocumentController::getTickMapCache()
+{
+    if (_tickMapCache == nullptr)
+        _tickMapCache = std::make_unique<TickMapCache> (*getDocumentController()->getDocument<ARADocument>());
+    
+    return *_tickMapCache;
+}
+
 ARAPlaybackRenderer* MidroAudioSyncDocumentController::doCreatePlaybackRenderer() noexcept
 {
-    return new MidroAudioSyncPlaybackRenderer (getDocumentController());
+    return new MidroAudioSyncPlaybackRenderer (getDocumentController(), getTickMapCache());
 }
 
 bool MidroAudioSyncDocumentController::doRestoreObjectsFromStream (ARAInputStream& input, const ARARestoreObjectsFilter* filter) noexcept
 {
+    // the compiled tick maps are only a cache: if they cannot be used they are simply rebuilt, the restore never fails because of them
+    getTickMapCache().restoreTickMaps (input);
     return true;
 }
 
 bool MidroAudioSyncDocumentController::doStoreObjectsToStream (ARAOutputStream& output, const ARAStoreObjectsFilter* filter) noexcept
 {
-    return true;
+    return getTickMapCache().storeTickMaps (output);
 }
 
 // This creates the static ARAFactory instances for the plugin.
@@ -27,6 +27,8 @@
 
 #include <juce_audio_processors/juce_audio_processors.h>
 
+#include "TickMapCache.h"
+
 
 
 class MidroAudioSyncDocumentController  : public juce::ARADocumentControllerSpecialisation
@@ -34,6 +36,8 @@ class MidroAudioSyncDocumentController  : public juce::ARADocumentControllerSpec
 public:
     using ARADocumentControllerSpecialisation::ARADocumentControllerSpecialisation;
 
+    // the tick maps of the document, shared by all its playback renderers
+    TickMapCache& getTickMapCache();
     
 protected:
     juce::ARAPlaybackRenderer* doCreatePlaybackRenderer() noexcept override;
@@ -42,5 +46,7 @@ protected:
 
 
 private:
+    std::unique_ptr<TickMapCache> _tickMapCache; // created with the first playback renderer
+    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidroAudioSyncDocumentController)
 };
@@ -24,54 +24,39 @@
 */
 
 #include "PluginARAPlaybackRenderer.h"
+#include "SyncFileExporter.h"
 
 using namespace juce;
 
 
-MidroAudioSyncPlaybackRenderer::MidroAudioSyncPlaybackRenderer(ARA::PlugIn::DocumentController* documentController) noexcept
-    : ARAPlaybackRenderer::ARAPlaybackRenderer(documentController)
+MidroAudioSyncPlaybackRenderer::MidroAudioSyncPlaybackRenderer(ARA::PlugIn::DocumentController* documentController, TickMapCache& tickMapCache) noexcept
+    : ARAPlaybackRenderer::ARAPlaybackRenderer(documentController),
+      tickMapCache(tickMapCache)
 {
-    tempoMap = std::make_unique<TempoMap> (*documentController->getDocument<ARADocument>());
+    tempoMap = std::make_unique<TempoMap> (tickMapCache); // the tick maps are built once for the whole document
+    signalRenderer = std::make_unique<SyncSignalRenderer> (*tempoMap);
 }
 
 
 
 
 //==============================================================================
-void MidroAudioSyncPlaybackRenderer::prepareToPlay (double sampleRateIn, int maximumSamplesPerBlockIn, int numChannelsIn, AudioProcessor::ProcessingPrecision, AlwaysNonRealtime alwaysNonRealtime)
+void MidroAudioSyncPlaybackRenderer::prepareToPlay (double sampleRateIn, int maximumSamplesPerBlockIn, int numChannelsIn, AudioProcessor::ProcessingPrecision precisionIn, AlwaysNonRealtime alwaysNonRealtime)
 {
     numChannels = numChannelsIn;
+    precision = precisionIn;
     sampleRate = sampleRateIn;
     maximumSamplesPerBlock = (unsigned int)maximumSamplesPerBlockIn;
     useBufferedAudioSourceReader = alwaysNonRealtime == AlwaysNonRealtime::no;
     
-    if (outputData != NULL)
-        delete[] outputData;
-    
-    outputData = new float[maximumSamplesPerBlock];
-    for (unsigned int i = 0 ; i < maximumSamplesPerBlock ; i++)
-        outputData[i] = 0.0f;
-    
-    TempoMap::setSampleRate(sampleRate);
-    
-    missingEndOfLowTick = 0;
-    missingEndOfHighTick = 0;
-    
-    // 0.006242976651267 seconds = tick length of a tempo of 400.45 BPM
-    minSamplesSinceLastTick = static_cast<unsigned int>(ceil(0.006242976651267 * sampleRate)); // ceil for a tempo < 400.45
-    
-    // 0.084602368866328 seconds = tick length of a tempo of 29.55 BPM
-    maxSamplesSinceLastTick = static_cast<unsigned int>(floor(0.084602368866328 * sampleRate)); // floor for a tempo > 29.55
-    samplesSinceLastTick = minSamplesSinceLastTick;
-    
-    currentTickIndex = 0;
+    tempoMap->setSampleRate(sampleRate);
+    signalRenderer->prepare(sampleRate, maximumSamplesPerBlockIn);
 }
 
 
 MidroAudioSyncPlaybackRenderer::~MidroAudioSyncPlaybackRenderer()
 {
-    if (outputData != NULL)
-        delete[] outputData;
+    exportThread.removeAllJobs(true, -1); // its TempoMap must be gone before the TickMapCache of our document
 }
 
 
@@ -79,6 +64,24 @@ MidroAudioSyncPlaybackRenderer::~MidroAudioSyncPlaybackRenderer()
 bool MidroAudioSyncPlaybackRenderer::processBlock (AudioBuffer<float>& buffer,
                                                        AudioProcessor::Realtime realtime,
                                                        const AudioPlayHead::PositionInfo& positionInfo) noexcept
+{
+    jassert (precision == AudioProcessor::singlePrecision);
+    return processBlockInPrecision (buffer, realtime, positionInfo);
+}
+
+bool MidroAudioSyncPlaybackRenderer::processBlock (AudioBuffer<double>& buffer,
+                                                       AudioProcessor::Realtime realtime,
+                                                       const AudioPlayHead::PositionInfo& positionInfo) noexcept
+{
+    jassert (precision == AudioProcessor::doublePrecision);
+    return processBlockInPrecision (buffer, realtime, positionInfo);
+}
+
+
+template <typename SampleType>
+bool MidroAudioSyncPlaybackRenderer::processBlockInPrecision (AudioBuffer<SampleType>& buffer,
+                                                                  AudioProcessor::Realtime realtime,
+                                                                  const AudioPlayHead::PositionInfo& positionInfo) noexcept
 {
     const auto numSamples = (unsigned int)(buffer.getNumSamples());
     jassert (numSamples <= maximumSamplesPerBlock);
@@ -89,99 +92,48 @@ bool MidroAudioSyncPlaybackRenderer::processBlock (AudioBuffer<float>& buffer,
 
     bool success = true;
     
-    if (!isPlaying && !sendSignalAlways) {
-        for (unsigned int i = 0 ; i < numSamples ; i++)
-            outputData[i] = 0.0f;
-    }
+    tempoMap->updateTickMap(); // takes the latest tick map (if it was rebuilt since the last block)
     
-    else {
-        unsigned int i = 0;
-        int64_t nextTick = 0;
-        bool lastTickRightBeforeABar = false;
-        
-        double tickLength = 0.0; // in seconds
-        unsigned int barLength = 0;
-        tempoMap->getTickAndBarLengthAtPosition(startTimeInSamples, tickLength, barLength);
-
-        
-        double nextTickInSeconds = -(((double)(samplesSinceLastTick))/sampleRate); // we start at "minus samplesSinceLastTick" position
-        
-        
-        while (i < numSamples && missingEndOfLowTick > 0) {
-            outputData[i++] = MidroAudioSyncPlaybackRenderer::lowTickSamples[LOW_TICK_LENGTH-missingEndOfLowTick];
-            missingEndOfLowTick--;
-        }
-        while (i < numSamples && missingEndOfHighTick > 0) {
-            outputData[i++] = MidroAudioSyncPlaybackRenderer::highTickSamples[HIGH_TICK_LENGTH-missingEndOfHighTick];
-            missingEndOfHighTick--;
-        }
-    
-    
-        while (i < numSamples) {
-            
-            if (!isPlaying) {
-                nextTickInSeconds += tickLength;
-                nextTick = static_cast<int64_t>(nextTickInSeconds*sampleRate);
-                
-                lastTickRightBeforeABar = false;
-                if (currentTickIndex >= barLength-1)
-                    lastTickRightBeforeABar = true;
-            }
-            else {
-                nextTick = tempoMap->getNextTickPositionInSamples(startTimeInSamples + i, lastTickRightBeforeABar) - startTimeInSamples;
-            }
-            
-            // that last conditon (maxSamplesSinceLastTick) will make sure we always send ticks to a tempo >= 29.55bpm to maintain sync at all times
-            while (i < numSamples && i < nextTick && samplesSinceLastTick < maxSamplesSinceLastTick) {
-                outputData[i++] = 0.0f;
-                samplesSinceLastTick++;
-            }
-            
-            if (i < numSamples) {
-                if (samplesSinceLastTick < minSamplesSinceLastTick) { // sending this tick would mean tempo > 400.55bpm => losing sync on the Midronome
-                    outputData[i++] = 0.0f; // we ignore this tick and next call to getNextTickPositionInSamples() will send the next tick
-                    samplesSinceLastTick++;
-                }
-                else {
-                    currentTickIndex++;
-                    if (lastTickRightBeforeABar) {
-                        currentTickIndex = 0;
-                        int length = HIGH_TICK_LENGTH;
-                        samplesSinceLastTick = HIGH_TICK_LENGTH; // that way we do not need to increase it in the missingEndOfXXXTick-- above
-                        if (i + HIGH_TICK_LENGTH > numSamples) {
-                            missingEndOfHighTick = i + HIGH_TICK_LENGTH - numSamples;
-                            length -= missingEndOfHighTick;
-                        }
-                        
-                        for (int j = 0 ; j < length ; j++)
-                            outputData[i++] = MidroAudioSyncPlaybackRenderer::highTickSamples[j];
-                    }
-                    else {
-                        int length = LOW_TICK_LENGTH;
-                        samplesSinceLastTick = LOW_TICK_LENGTH; // same
-                        if (i + LOW_TICK_LENGTH > numSamples) {
-                            missingEndOfLowTick = i + LOW_TICK_LENGTH - numSamples;
-                            length -= missingEndOfLowTick;
-                        }
-                        
-                        for (int j = 0 ; j < length ; j++)
-                            outputData[i++] = MidroAudioSyncPlaybackRenderer::lowTickSamples[j];
-                    }
-                }
-            }
-        }
-    }
-    
-    
-    for (int c = 0; c < numChannels; c++)
-    {
-        auto* channelData = buffer.getWritePointer (c);
-        for (unsigned int i = 0; i < numSamples; ++i)
-            channelData[i] = outputData[i];
-    }
+    signalRenderer->render(buffer, startTimeInSamples, isPlaying);
 
     return success;
 }
 
 
 
+bool MidroAudioSyncPlaybackRenderer::exportSyncFile(const File& file, std::function<void (bool success)> onFinished)
+{
+    if (exportThread.getNumJobs() > 0)
+        return false;
+    
+    double endTime = 0.0;
+    for (auto* playbackRegion : getPlaybackRegions())
+        endTime = jmax(endTime, playbackRegion->getEndInPlaybackTime());
+    
+    if (endTime <= 0.0)
+        return false;
+    
+    // everything the export needs is read here, the ARA model graph and our settings belong to the message thread
+    const double exportSampleRate = sampleRate;
+    const int exportNumChannels = numChannels;
+    const double delay = tempoMap->getDelay();
+    const bool subSampleTicks = tempoMap->getSubSampleTicks();
+    const auto lengthInSamples = static_cast<int64_t>(ceil(endTime * exportSampleRate));
+    
+    exportThread.addJob([&exportTickMapCache = tickMapCache, file, exportSampleRate, exportNumChannels, delay, subSampleTicks, lengthInSamples, onFinished = std::move(onFinished)] {
+        // our TempoMap belongs to the audio thread, the export gets its own one (which shares the tick map with it)
+        TempoMap exportTempoMap(exportTickMapCache);
+        exportTempoMap.setSampleRate(exportSampleRate); // can wait for the TickMapCache thread
+        exportTempoMap.setDelay(delay);
+        exportTempoMap.setSubSampleTicks(subSampleTicks);
+        exportTempoMap.updateTickMap();
+        
+        auto* job = ThreadPoolJob::getCurrentThreadPoolJob();
+        const bool success = SyncFileExporter::exportToWav(exportTempoMap, exportSampleRate, lengthInSamples, file, exportNumChannels,
+                                                           16, 0, [job] { return job != nullptr && job->shouldExit(); });
+        
+        MessageManager::callAsync([onFinished, success] { onFinished(success); });
+    });
+    
+    return true;
+}
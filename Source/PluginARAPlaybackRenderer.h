@@ -29,7 +29,8 @@
 #include <JuceHeader.h>
 #include <juce_audio_processors/juce_audio_processors.h>
 
-#include "TempoMap.h"
+#include "TickMapCache.h"
+#include "SyncSignalRenderer.h"
 
 
 
@@ -41,7 +42,7 @@ class MidroAudioSyncPlaybackRenderer  : public juce::ARAPlaybackRenderer
 {
 public:
     //==============================================================================
-    explicit MidroAudioSyncPlaybackRenderer(ARA::PlugIn::DocumentController* documentController) noexcept;
+    MidroAudioSyncPlaybackRenderer(ARA::PlugIn::DocumentController* documentController, TickMapCache& tickMapCache) noexcept;
     
     ~MidroAudioSyncPlaybackRenderer();
 
@@ -49,7 +50,7 @@ public:
     void prepareToPlay (double sampleRate,
                         int maximumSamplesPerBlock,
                         int numChannels,
-                        juce::AudioProcessor::ProcessingPrecision,
+                        juce::AudioProcessor::ProcessingPrecision precision,
                         AlwaysNonRealtime alwaysNonRealtime) override;
     
 
@@ -58,75 +59,49 @@ public:
                        juce::AudioProcessor::Realtime realtime,
                        const juce::AudioPlayHead::PositionInfo& positionInfo) noexcept override;
     
+    // same, for hosts processing in double precision: the signal is rendered straight in double, no conversion involved
+    bool processBlock (juce::AudioBuffer<double>& buffer,
+                       juce::AudioProcessor::Realtime realtime,
+                       const juce::AudioPlayHead::PositionInfo& positionInfo) noexcept override;
+    
     
     
     void setTempoMapDelay(double delay) { tempoMap->setDelay(delay); }
     double getTempoMapDelay() { return tempoMap->getDelay(); }
     
-    void setSendSignalAlways(bool val) { sendSignalAlways = val; }
-    bool getSendSignalAlways() { return sendSignalAlways; }
+    void setSendSignalAlways(bool val) { signalRenderer->setSendSignalAlways(val); }
+    bool getSendSignalAlways() { return signalRenderer->getSendSignalAlways(); }
+    
+    // see TempoMap::setSubSampleTicks(), also used by the export
+    void setSubSampleTicks(bool val) { tempoMap->setSubSampleTicks(val); }
+    bool getSubSampleTicks() { return tempoMap->getSubSampleTicks(); }
+    
+    // Message thread: renders the signal of our playback regions (from the start of the song to the end of the last one)
+    // into a WAV file at our sample rate, as it would be sent while playing. The export runs on its own thread, onFinished
+    // is then called on the message thread with its result. Returns false if it could not start (nothing to export, or
+    // an export is already running).
+    bool exportSyncFile(const juce::File& file, std::function<void (bool success)> onFinished);
     
 private:
+    
+    template <typename SampleType>
+    bool processBlockInPrecision (juce::AudioBuffer<SampleType>& buffer,
+                                  juce::AudioProcessor::Realtime realtime,
+                                  const juce::AudioPlayHead::PositionInfo& positionInfo) noexcept;
         
     //==============================================================================
     double sampleRate = 44100.0;
     unsigned int maximumSamplesPerBlock = 4096;
     int numChannels = 1;
+    juce::AudioProcessor::ProcessingPrecision precision = juce::AudioProcessor::singlePrecision;
     bool useBufferedAudioSourceReader = true;
     
-    bool sendSignalAlways = false;
-    
+    TickMapCache& tickMapCache;
     std::unique_ptr<TempoMap> tempoMap;
+    std::unique_ptr<SyncSignalRenderer> signalRenderer; // uses tempoMap
     
-    float* outputData = NULL;
-    
-    
-    unsigned int missingEndOfLowTick = 0;
-    unsigned int missingEndOfHighTick = 0;
+    juce::ThreadPool exportThread { 1 }; // an export still running when we are destroyed is cancelled
     
-    unsigned int samplesSinceLastTick = 0; // to avoid sending two ticks "too close" to each other
-    unsigned int minSamplesSinceLastTick = 0;
-    unsigned int maxSamplesSinceLastTick = 0;
     
-    unsigned int currentTickIndex = 0;
-    
-    
-    
-    #define TICK_HEIGHT         0.35f
-    #define BAR_TICK_HEIGHT     0.95f
-    #define HIGH_TICK_LENGTH    26
-    #define LOW_TICK_LENGTH     13
-
-
-    static constexpr const float highTickSamples[HIGH_TICK_LENGTH] = {
-        TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT,
-        TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT,
-        TICK_HEIGHT,
-        TICK_HEIGHT + ((1.0f/5.0f)*(BAR_TICK_HEIGHT-TICK_HEIGHT)),
-        TICK_HEIGHT + ((2.0f/5.0f)*(BAR_TICK_HEIGHT-TICK_HEIGHT)),
-        TICK_HEIGHT + ((3.0f/5.0f)*(BAR_TICK_HEIGHT-TICK_HEIGHT)),
-        TICK_HEIGHT + ((4.0f/5.0f)*(BAR_TICK_HEIGHT-TICK_HEIGHT)),
-        BAR_TICK_HEIGHT,
-        BAR_TICK_HEIGHT,
-        BAR_TICK_HEIGHT,
-        BAR_TICK_HEIGHT - ((1.0f/9.0f)*BAR_TICK_HEIGHT),
-        BAR_TICK_HEIGHT - ((2.0f/9.0f)*BAR_TICK_HEIGHT),
-        BAR_TICK_HEIGHT - ((3.0f/9.0f)*BAR_TICK_HEIGHT),
-        BAR_TICK_HEIGHT - ((4.0f/9.0f)*BAR_TICK_HEIGHT),
-        BAR_TICK_HEIGHT - ((5.0f/9.0f)*BAR_TICK_HEIGHT),
-        BAR_TICK_HEIGHT - ((6.0f/9.0f)*BAR_TICK_HEIGHT),
-        BAR_TICK_HEIGHT - ((7.0f/9.0f)*BAR_TICK_HEIGHT),
-        BAR_TICK_HEIGHT - ((8.0f/9.0f)*BAR_TICK_HEIGHT)
-    };
-
-    static constexpr const float lowTickSamples[LOW_TICK_LENGTH] = {
-        TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT,
-        TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT, TICK_HEIGHT,
-        TICK_HEIGHT,
-        TICK_HEIGHT - ((1.0f/3.0f)*TICK_HEIGHT),
-        TICK_HEIGHT - ((2.0f/3.0f)*TICK_HEIGHT)
-    };
-    
-
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidroAudioSyncPlaybackRenderer)
 };
@@ -56,6 +56,14 @@ MidroAudioSyncAudioProcessorEditor::MidroAudioSyncAudioProcessorEditor (MidroAud
     _button.setButtonText("Only send signal when playing");
     _button.onClick = [this] { setSendSignalAlwaysFromButton(); };
     
+    addAndMakeVisible(_subSampleButton);
+    _subSampleButton.setButtonText("Place ticks between samples");
+    _subSampleButton.onClick = [this] { setSubSampleTicksFromButton(); };
+    
+    addAndMakeVisible(_exportButton);
+    _exportButton.setButtonText("Export to WAV...");
+    _exportButton.onClick = [this] { exportSyncFileFromButton(); };
+    
     
     if (isARAEditorView()) {
         MidroAudioSyncPlaybackRenderer *renderer = dynamic_cast<MidroAudioSyncPlaybackRenderer*>(audioProcessor.getPlaybackRenderer());
@@ -63,6 +71,7 @@ MidroAudioSyncAudioProcessorEditor::MidroAudioSyncAudioProcessorEditor (MidroAud
         if (renderer) {
             _delaySlider.setValue(renderer->getTempoMapDelay()*1000.0, dontSendNotification);
             _button.setToggleState(!renderer->getSendSignalAlways(), dontSendNotification);
+            _subSampleButton.setToggleState(renderer->getSubSampleTicks(), dontSendNotification);
         }
     }
 }
@@ -82,6 +91,48 @@ void MidroAudioSyncAudioProcessorEditor::setSendSignalAlwaysFromButton() {
 }
 
 
+void MidroAudioSyncAudioProcessorEditor::setSubSampleTicksFromButton() {
+    if (isARAEditorView()) {
+        MidroAudioSyncPlaybackRenderer *renderer = dynamic_cast<MidroAudioSyncPlaybackRenderer*>(audioProcessor.getPlaybackRenderer());
+        
+        if (renderer)
+            renderer->setSubSampleTicks(_subSampleButton.getToggleState());
+    }
+}
+
+
+void MidroAudioSyncAudioProcessorEditor::exportSyncFileFromButton() {
+    if (!isARAEditorView())
+        return;
+    
+    _exportFileChooser = std::make_unique<FileChooser>("Export the sync signal", File(), "*.wav");
+    
+    const auto flags = FileBrowserComponent::saveMode | FileBrowserComponent::canSelectFiles | FileBrowserComponent::warnAboutOverwriting;
+    _exportFileChooser->launchAsync(flags, [this] (const FileChooser& chooser) {
+        const File file = chooser.getResult();
+        if (file == File())
+            return;
+        
+        MidroAudioSyncPlaybackRenderer *renderer = dynamic_cast<MidroAudioSyncPlaybackRenderer*>(audioProcessor.getPlaybackRenderer());
+        if (!renderer)
+            return;
+        
+        const File wavFile = file.withFileExtension("wav");
+        
+        // the export runs on its own thread, the result comes back on the message thread (even if the editor was closed)
+        const bool started = renderer->exportSyncFile(wavFile, [wavFile] (bool success) {
+            if (!success)
+                AlertWindow::showMessageBoxAsync(MessageBoxIconType::WarningIcon, "Export failed",
+                                                 "The sync signal could not be written to " + wavFile.getFullPathName());
+        });
+        
+        if (!started)
+            AlertWindow::showMessageBoxAsync(MessageBoxIconType::WarningIcon, "Export failed",
+                                             "There is nothing to export yet, or an export is already running.");
+    });
+}
+
+
 void MidroAudioSyncAudioProcessorEditor::setDelayOnTempoMap() {
     if (isARAEditorView()) {
         MidroAudioSyncPlaybackRenderer *renderer = dynamic_cast<MidroAudioSyncPlaybackRenderer*>(audioProcessor.getPlaybackRenderer());
@@ -118,5 +169,7 @@ void MidroAudioSyncAudioProcessorEditor::resized()
             width = 600;
         _delaySlider.setBounds (sliderLeft, 20, getWidth() - sliderLeft - 10, 20);
         _button.setBounds(sliderLeft, 60, getWidth() - sliderLeft - 10, 20);
+        _subSampleButton.setBounds(sliderLeft, 90, getWidth() - sliderLeft - 10, 20);
+        _exportButton.setBounds(sliderLeft, 130, 150, 24);
     }
 }
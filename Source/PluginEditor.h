@@ -44,6 +44,10 @@ public:
     void resized() override;
     
     void setSendSignalAlwaysFromButton();
+    
+    void setSubSampleTicksFromButton();
+    
+    void exportSyncFileFromButton();
 
 private:
     
@@ -55,6 +59,10 @@ private:
     juce::Label  _delayLabel;
     
     juce::ToggleButton _button;
+    juce::ToggleButton _subSampleButton;
+    
+    juce::TextButton _exportButton;
+    std::unique_ptr<juce::FileChooser> _exportFileChooser;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidroAudioSyncAudioProcessorEditor)
 };
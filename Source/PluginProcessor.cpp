@@ -157,6 +157,14 @@ void MidroAudioSyncAudioProcessor::processBlock (AudioBuffer<float>& buffer, Mid
 		processBlockBypassed (buffer, midiMessages);
 }
 
+void MidroAudioSyncAudioProcessor::processBlock (AudioBuffer<double>& buffer, MidiBuffer& midiMessages)
+{
+    ScopedNoDenormals noDenormals;
+
+	if (!processBlockForARA (buffer, isRealtime(), getPlayHead()))
+		processBlockBypassed (buffer, midiMessages);
+}
+
 
 bool MidroAudioSyncAudioProcessor::hasEditor() const
 {
@@ -180,7 +188,7 @@ void MidroAudioSyncAudioProcessor::getStateInformation (MemoryBlock& destData)
         return;
     
     destData.reset();
-    destData.setSize(sizeof(double)+sizeof(char));
+    destData.setSize(sizeof(double)+2*sizeof(char));
     
     char *data = (char*)destData.getData();
     *((double*)data) = renderer->getTempoMapDelay();
@@ -188,6 +196,7 @@ void MidroAudioSyncAudioProcessor::getStateInformation (MemoryBlock& destData)
     if (renderer->getSendSignalAlways())
         sendSignalAlways = 1;
     *(data+sizeof(double)) = sendSignalAlways;
+    *(data+sizeof(double)+1) = renderer->getSubSampleTicks() ? 1 : 0;
 }
 
 void MidroAudioSyncAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
@@ -210,6 +219,9 @@ void MidroAudioSyncAudioProcessor::setStateInformation (const void* data, int si
     
     renderer->setTempoMapDelay(delay);
     renderer->setSendSignalAlways(sendSignalAlways);
+    
+    // (not in the states saved before sub-sample ticks existed)
+    renderer->setSubSampleTicks(sizeInBytes > (sizeof(double)+sizeof(char)) && *(((char*)data)+sizeof(double)+1) != 0);
 }
 
 
@@ -48,6 +48,10 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    
+    // the signal is rendered in the precision of the host, see MidroAudioSyncPlaybackRenderer
+    bool supportsDoublePrecisionProcessing() const override { return true; }
 
     
     juce::AudioProcessorEditor* createEditor() override;
@@ -0,0 +1,178 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "SyncFileExporter.h"
+
+
+using namespace juce;
+
+
+bool SyncFileExporter::exportToWav(TempoMap& tempoMap, double sampleRate, int64_t lengthInSamples, const File& file,
+                                   int numChannels, int bitsPerSample, int numThreads, const std::function<bool()>& shouldCancel)
+{
+    const SyncSignal::TickWaveforms tickWaveforms (sampleRate);
+    
+    std::vector<Pulse> pulses;
+    if (lengthInSamples <= 0 || numChannels <= 0 || !getPulses(tempoMap, sampleRate, tickWaveforms, lengthInSamples, pulses))
+        return false;
+    
+    file.deleteFile();
+    std::unique_ptr<OutputStream> stream = file.createOutputStream();
+    if (stream == nullptr)
+        return false;
+    
+    WavAudioFormat wavFormat;
+    std::unique_ptr<AudioFormatWriter> writer (wavFormat.createWriterFor (stream.get(), sampleRate, static_cast<unsigned int>(numChannels),
+                                                                          bitsPerSample, {}, 0));
+    if (writer == nullptr) {
+        stream.reset();
+        file.deleteFile();
+        return false;
+    }
+    
+    stream.release(); // the writer owns it now
+    
+    
+    // every chunk of a batch is rendered on the thread pool, then the batch is written while the pool waits
+    ThreadPool threadPool (numThreads > 0 ? numThreads : SystemStats::getNumCpus());
+    std::vector<float> batch (static_cast<size_t>(chunkLength) * chunksPerBatch);
+    std::vector<const float*> channels (static_cast<size_t>(numChannels), batch.data()); // every channel gets the same signal
+    
+    for (int64_t batchStart = 0 ; batchStart < lengthInSamples ; batchStart += static_cast<int64_t>(batch.size())) {
+        if (shouldCancel != nullptr && shouldCancel()) {
+            writer.reset();
+            file.deleteFile();
+            return false;
+        }
+        
+        const int batchLength = static_cast<int>(std::min(static_cast<int64_t>(batch.size()), lengthInSamples - batchStart));
+        const int numChunks = (batchLength + chunkLength - 1) / chunkLength;
+        
+        std::atomic<int> remainingChunks { numChunks };
+        WaitableEvent batchRendered;
+        
+        for (int c = 0 ; c < numChunks ; c++) {
+            threadPool.addJob ([&, c] {
+                const int start = c * chunkLength;
+                renderChunk(pulses, tickWaveforms, batchStart + start, std::min(chunkLength, batchLength - start), batch.data() + start);
+                
+                if (--remainingChunks == 0)
+                    batchRendered.signal();
+            });
+        }
+        
+        batchRendered.wait();
+        
+        if (!writer->writeFromFloatArrays(channels.data(), numChannels, batchLength)) {
+            writer.reset(); // a failed export must not leave a file which looks valid
+            file.deleteFile();
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+
+bool SyncFileExporter::getPulses(TempoMap& tempoMap, double sampleRate, const SyncSignal::TickWaveforms& tickWaveforms,
+                                 int64_t lengthInSamples, std::vector<Pulse>& pulses)
+{
+    double tickLength = 0.0;
+    unsigned int barLength = 0;
+    if (!tempoMap.getTickAndBarLengthAtPosition(0, tickLength, barLength))
+        return false; // no tick map
+    
+    // all the ticks up to the end, plus the first one after it (needed when we have to send a tick before it is due)
+    std::vector<TempoMap::Tick> ticks;
+    {
+        std::vector<TempoMap::Tick> blockTicks (chunkLength + 1);
+        TempoMap::Tick tickAfterBlock { 0, false };
+        
+        for (int64_t blockStart = 0 ; blockStart < lengthInSamples ; blockStart += chunkLength) {
+            const int64_t blockEnd = std::min(lengthInSamples, blockStart + chunkLength);
+            const int numTicks = tempoMap.getTicksInBlock(blockStart, blockEnd, blockTicks.data(), (int)blockTicks.size(), tickAfterBlock);
+            ticks.insert(ticks.end(), blockTicks.begin(), blockTicks.begin() + numTicks);
+        }
+        
+        ticks.push_back(tickAfterBlock);
+    }
+    
+    // the same rules as the playback renderer, see SyncSignalRenderer::renderSignal() and SyncSignal
+    const int64_t minSamplesBetweenTicks = static_cast<int64_t>(ceil(SyncSignal::minTickLengthInSeconds * sampleRate));
+    const int64_t maxSamplesBetweenTicks = static_cast<int64_t>(floor(SyncSignal::maxTickLengthInSeconds * sampleRate));
+    
+    int64_t lastPulse = -minSamplesBetweenTicks; // as after prepareToPlay()
+    int64_t position = 0; // first sample where a tick can be sent
+    size_t tickIdx = 0;
+    
+    while (position < lengthInSamples) {
+        // ticks which we decided to ignore are skipped
+        while (tickIdx+1 < ticks.size() && ticks[tickIdx].position < position)
+            tickIdx++;
+        
+        const TempoMap::Tick& tick = ticks[tickIdx];
+        const int64_t pulsePosition = std::min(tick.position, lastPulse + maxSamplesBetweenTicks);
+        
+        if (pulsePosition >= lengthInSamples)
+            break;
+        
+        if (pulsePosition - lastPulse < minSamplesBetweenTicks) {
+            position = pulsePosition + 1; // we ignore this tick
+            continue;
+        }
+        
+        if (tempoMap.getSubSampleTicks() && pulsePosition == tick.position) // same as the playback renderer
+            pulses.push_back({ pulsePosition, tickWaveforms.getDelayedTick(tick.lastTickRightBeforeABar, tick.subSamplePosition) });
+        else
+            pulses.push_back({ pulsePosition, tickWaveforms.getTick(tick.lastTickRightBeforeABar) });
+        
+        lastPulse = pulsePosition;
+        position = pulsePosition + 1; // ticks during the pulse are too close to it and will be ignored
+    }
+    
+    return true;
+}
+
+
+void SyncFileExporter::renderChunk(const std::vector<Pulse>& pulses, const SyncSignal::TickWaveforms& tickWaveforms, int64_t chunkStart,
+                                   int numSamples, float* output)
+{
+    std::fill(output, output + numSamples, 0.0f);
+    
+    // the first pulse which can still be heard in this chunk (the longest one is a delayed high tick), pulses are added
+    // together in case they overlap
+    auto pulse = std::lower_bound(pulses.begin(), pulses.end(), chunkStart - tickWaveforms.getMaximumLength() + 1, [] (const Pulse& p, int64_t position) {
+        return p.position < position;
+    });
+    
+    for ( ; pulse != pulses.end() && pulse->position < chunkStart + numSamples ; pulse++) {
+        const int first = static_cast<int>(std::max((int64_t)0, chunkStart - pulse->position));
+        const int last = static_cast<int>(std::min((int64_t)pulse->waveform.length, chunkStart + numSamples - pulse->position));
+        
+        for (int j = first ; j < last ; j++)
+            output[pulse->position + j - chunkStart] += pulse->waveform.floatSamples[j];
+    }
+}
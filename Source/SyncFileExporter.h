@@ -0,0 +1,66 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "TempoMap.h"
+#include "SyncSignal.h"
+
+
+// Renders the sync signal offline, e.g. to use it like the files of the MidroSync File Generator
+class SyncFileExporter
+{
+public:
+    // Writes the signal from position 0 to lengthInSamples into a WAV file, exactly as the playback renderer sends it while
+    // playing from position 0. tempoMap must already have its tick map at sampleRate (see TempoMap::updateTickMap()) and
+    // must not be used by an audio thread at the same time.
+    // The ticks are taken from the tick map first, then the audio is rendered in chunks on numThreads threads (0 = one per
+    // CPU) and written as it goes, so the file is never held in memory. shouldCancel (if any) is called between the batches
+    // of chunks: when it returns true, the export stops and the file is deleted.
+    static bool exportToWav(TempoMap& tempoMap, double sampleRate, int64_t lengthInSamples, const juce::File& file,
+                            int numChannels = 2, int bitsPerSample = 16, int numThreads = 0,
+                            const std::function<bool()>& shouldCancel = nullptr);
+    
+    
+private:
+    
+    struct Pulse {
+        int64_t position; // in samples
+        SyncSignal::TickWaveform waveform; // in the TickWaveforms
+    };
+    
+    // the ticks actually sent, see SyncSignalRenderer::renderSignal()
+    static bool getPulses(TempoMap& tempoMap, double sampleRate, const SyncSignal::TickWaveforms& tickWaveforms,
+                          int64_t lengthInSamples, std::vector<Pulse>& pulses);
+    
+    // chunks only depend on the pulses, a pulse starting in the previous chunk is finished in this one
+    static void renderChunk(const std::vector<Pulse>& pulses, const SyncSignal::TickWaveforms& tickWaveforms, int64_t chunkStart,
+                            int numSamples, float* output);
+    
+    static constexpr int chunkLength = 1 << 16; // in samples
+    static constexpr int chunksPerBatch = 64; // rendered in parallel, then written before the next batch
+};
@@ -0,0 +1,172 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include "SyncSignal.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+    // The pulses as functions of time, in samples at 44.1/48 kHz: straight lines between the samples of SyncSignal's tables
+    constexpr float highTickAt(double position)
+    {
+        if (position <= 10.0)
+            return SyncSignal::tickHeight;
+        if (position < 15.0)
+            return SyncSignal::tickHeight + (static_cast<float>((position - 10.0)/5.0)*(SyncSignal::barTickHeight-SyncSignal::tickHeight));
+        if (position <= 17.0)
+            return SyncSignal::barTickHeight;
+        return SyncSignal::barTickHeight - (static_cast<float>((position - 17.0)/9.0)*SyncSignal::barTickHeight);
+    }
+    
+    constexpr float lowTickAt(double position)
+    {
+        if (position <= 10.0)
+            return SyncSignal::tickHeight;
+        return SyncSignal::tickHeight - (static_cast<float>((position - 10.0)/3.0)*SyncSignal::tickHeight);
+    }
+    
+    
+    // the pulses at stretch times 44.1/48 kHz
+    template <typename SampleType, int stretch>
+    struct StretchedTickTables
+    {
+        SampleType high[SyncSignal::highTickTableLength * stretch] {};
+        SampleType low[SyncSignal::lowTickTableLength * stretch] {};
+        
+        constexpr StretchedTickTables()
+        {
+            for (int j = 0 ; j < SyncSignal::highTickTableLength * stretch ; j++)
+                high[j] = highTickAt(static_cast<double>(j) / stretch);
+            
+            for (int j = 0 ; j < SyncSignal::lowTickTableLength * stretch ; j++)
+                low[j] = lowTickAt(static_cast<double>(j) / stretch);
+        }
+    };
+    
+    // (the float tables of 44.1 and 48 kHz are SyncSignal's)
+    constexpr StretchedTickTables<double, 1> doubleTickTablesX1;   // 44.1 and 48 kHz
+    constexpr StretchedTickTables<float, 2>  tickTablesX2;         // 88.2 and 96 kHz
+    constexpr StretchedTickTables<double, 2> doubleTickTablesX2;
+    constexpr StretchedTickTables<float, 4>  tickTablesX4;         // 176.4 and 192 kHz
+    constexpr StretchedTickTables<double, 4> doubleTickTablesX4;
+    constexpr StretchedTickTables<float, 8>  tickTablesX8;         // 352.8 and 384 kHz
+    constexpr StretchedTickTables<double, 8> doubleTickTablesX8;
+    
+    
+    // the functions above must give the pulses which have always been sent at 44.1/48 kHz
+    constexpr bool sameAsSyncSignalTables(const StretchedTickTables<float, 1>& tables)
+    {
+        for (int j = 0 ; j < SyncSignal::highTickTableLength ; j++)
+            if (tables.high[j] != SyncSignal::highTickSamples[j])
+                return false;
+        
+        for (int j = 0 ; j < SyncSignal::lowTickTableLength ; j++)
+            if (tables.low[j] != SyncSignal::lowTickSamples[j])
+                return false;
+        
+        return true;
+    }
+    
+    static_assert(sameAsSyncSignalTables(StretchedTickTables<float, 1>()), "the pulses do not match SyncSignal's tables");
+}
+
+
+void SyncSignal::TickWaveforms::setSampleRate(double sampleRate)
+{
+    int stretch = 0;
+    for (int s = 1 ; s <= 8 && stretch == 0 ; s *= 2)
+        if (sampleRate == 44100.0 * s || sampleRate == 48000.0 * s)
+            stretch = s;
+    
+    // any other sample rate: the 48 kHz pulses, resampled (at least one sample each, for very low sample rates)
+    const double samplesPerTableSample = sampleRate / 48000.0;
+    const int highTickLength = (stretch > 0) ? SyncSignal::highTickTableLength * stretch : std::max(1, static_cast<int>(std::lround(SyncSignal::highTickTableLength * samplesPerTableSample)));
+    const int lowTickLength = (stretch > 0) ? SyncSignal::lowTickTableLength * stretch : std::max(1, static_cast<int>(std::lround(SyncSignal::lowTickTableLength * samplesPerTableSample)));
+    
+    // the resampled pulses, then every phase of the delayed ones: reserved so that the pulses can point to them as we go
+    _floatSamples.clear();
+    _floatSamples.reserve(static_cast<size_t>((stretch > 0 ? 0 : highTickLength + lowTickLength)
+                                              + numSubSamplePhases * (highTickLength + 1 + lowTickLength + 1)));
+    
+    switch (stretch) {
+        case 1:
+            _highTick = { SyncSignal::highTickSamples, doubleTickTablesX1.high, highTickLength };
+            _lowTick = { SyncSignal::lowTickSamples, doubleTickTablesX1.low, lowTickLength };
+            break;
+        case 2:
+            _highTick = { tickTablesX2.high, doubleTickTablesX2.high, highTickLength };
+            _lowTick = { tickTablesX2.low, doubleTickTablesX2.low, lowTickLength };
+            break;
+        case 4:
+            _highTick = { tickTablesX4.high, doubleTickTablesX4.high, highTickLength };
+            _lowTick = { tickTablesX4.low, doubleTickTablesX4.low, lowTickLength };
+            break;
+        case 8:
+            _highTick = { tickTablesX8.high, doubleTickTablesX8.high, highTickLength };
+            _lowTick = { tickTablesX8.low, doubleTickTablesX8.low, lowTickLength };
+            break;
+            
+        default:
+            _highTick = { _floatSamples.data() + _floatSamples.size(), nullptr, highTickLength };
+            for (int j = 0 ; j < highTickLength ; j++)
+                _floatSamples.push_back(highTickAt(j / samplesPerTableSample));
+            
+            _lowTick = { _floatSamples.data() + _floatSamples.size(), nullptr, lowTickLength };
+            for (int j = 0 ; j < lowTickLength ; j++)
+                _floatSamples.push_back(lowTickAt(j / samplesPerTableSample));
+            
+            break;
+    }
+    
+    // phase k is delayed by (k + 0.5)/numSubSamplePhases sample, the middle of the sub-sample positions it is used for
+    auto delay = [this] (const TickWaveform& pulse) {
+        const TickWaveform delayedPulse { _floatSamples.data() + _floatSamples.size(), nullptr, pulse.length + 1 };
+        
+        for (int k = 0 ; k < numSubSamplePhases ; k++) {
+            const float fraction = (static_cast<float>(k) + 0.5f) / numSubSamplePhases;
+            
+            for (int j = 0 ; j <= pulse.length ; j++) {
+                const float sample = (j < pulse.length) ? pulse.floatSamples[j] : 0.0f;
+                const float previousSample = (j > 0) ? pulse.floatSamples[j-1] : 0.0f;
+                _floatSamples.push_back((1.0f - fraction) * sample + fraction * previousSample);
+            }
+        }
+        
+        return delayedPulse;
+    };
+    
+    _delayedHighTick = delay(_highTick);
+    _delayedLowTick = delay(_lowTick);
+    
+    // the same samples in double
+    _doubleSamples.assign(_floatSamples.begin(), _floatSamples.end());
+    
+    for (TickWaveform* pulse : { &_highTick, &_lowTick, &_delayedHighTick, &_delayedLowTick })
+        if (pulse->doubleSamples == nullptr)
+            pulse->doubleSamples = _doubleSamples.data() + (pulse->floatSamples - _floatSamples.data());
+}
@@ -0,0 +1,141 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <type_traits>
+#include <vector>
+
+
+// The MidroSync signal, shared by the playback renderer and the sync file export: a short pulse on each tick, and a longer
+// one going higher on the last tick before a bar
+struct SyncSignal
+{
+    static constexpr float tickHeight = 0.35f;
+    static constexpr float barTickHeight = 0.95f; // the peak of the high ticks
+    static constexpr int highTickTableLength = 26;
+    static constexpr int lowTickTableLength = 13;
+
+
+    static constexpr const float highTickSamples[highTickTableLength] = {
+        tickHeight, tickHeight, tickHeight, tickHeight, tickHeight,
+        tickHeight, tickHeight, tickHeight, tickHeight, tickHeight,
+        tickHeight,
+        tickHeight + ((1.0f/5.0f)*(barTickHeight-tickHeight)),
+        tickHeight + ((2.0f/5.0f)*(barTickHeight-tickHeight)),
+        tickHeight + ((3.0f/5.0f)*(barTickHeight-tickHeight)),
+        tickHeight + ((4.0f/5.0f)*(barTickHeight-tickHeight)),
+        barTickHeight,
+        barTickHeight,
+        barTickHeight,
+        barTickHeight - ((1.0f/9.0f)*barTickHeight),
+        barTickHeight - ((2.0f/9.0f)*barTickHeight),
+        barTickHeight - ((3.0f/9.0f)*barTickHeight),
+        barTickHeight - ((4.0f/9.0f)*barTickHeight),
+        barTickHeight - ((5.0f/9.0f)*barTickHeight),
+        barTickHeight - ((6.0f/9.0f)*barTickHeight),
+        barTickHeight - ((7.0f/9.0f)*barTickHeight),
+        barTickHeight - ((8.0f/9.0f)*barTickHeight)
+    };
+
+    static constexpr const float lowTickSamples[lowTickTableLength] = {
+        tickHeight, tickHeight, tickHeight, tickHeight, tickHeight,
+        tickHeight, tickHeight, tickHeight, tickHeight, tickHeight,
+        tickHeight,
+        tickHeight - ((1.0f/3.0f)*tickHeight),
+        tickHeight - ((2.0f/3.0f)*tickHeight)
+    };
+    
+    
+    // ticks closer than the tick length of a tempo of 400.45 BPM would make the Midronome lose sync, they are not sent
+    static constexpr double minTickLengthInSeconds = 0.006242976651267;
+    
+    // and we send a tick at least every tick length of a tempo of 29.55 BPM, to maintain sync at all times
+    static constexpr double maxTickLengthInSeconds = 0.084602368866328;
+    
+    
+    // One pulse, in both precisions (the double samples are exactly the float ones, so both give the same signal)
+    struct TickWaveform
+    {
+        const float* floatSamples = nullptr;
+        const double* doubleSamples = nullptr;
+        int length = 0;
+        
+        template <typename SampleType>
+        const SampleType* getSamples() const noexcept {
+            if constexpr (std::is_same_v<SampleType, double>)
+                return doubleSamples;
+            else
+                return floatSamples;
+        }
+    };
+    
+    
+    // The pulses above are the ones sent at 44.1 and 48 kHz. At higher sample rates they are stretched to last as long, so
+    // that the Midronome gets the same pulses whatever the sample rate of the session: the multiples of 44.1 and 48 kHz up
+    // to 384 kHz have their tables built at compile time, any other sample rate gets the 48 kHz pulses resampled.
+    // The tables are chosen once, before rendering, the signal is then only made of copies of them.
+    class TickWaveforms
+    {
+    public:
+        explicit TickWaveforms(double sampleRate = 48000.0) { setSampleRate(sampleRate); }
+        
+        TickWaveforms(const TickWaveforms&) = delete; // the pulses can point to our own samples
+        TickWaveforms& operator=(const TickWaveforms&) = delete;
+        
+        // allocates, not to be called from the audio thread
+        void setSampleRate(double sampleRate);
+        
+        // high = last tick before a bar
+        TickWaveform getTick(bool high) const noexcept { return high ? _highTick : _lowTick; }
+        
+        // For ticks subSamplePosition/65536 sample after the first sample of their pulse (see TempoMap::setSubSampleTicks()):
+        // the pulses delayed by that fraction of a sample, hence one sample longer. Each pulse is precomputed for
+        // numSubSamplePhases delays, by linear interpolation between its samples (the pulses start with a step, that way
+        // they do not ring before their tick).
+        static constexpr int numSubSamplePhases = 32;
+        
+        TickWaveform getDelayedTick(bool high, int subSamplePosition) const noexcept {
+            const TickWaveform& firstPhase = high ? _delayedHighTick : _delayedLowTick;
+            const int offset = (subSamplePosition * numSubSamplePhases / 65536) * firstPhase.length;
+            return { firstPhase.floatSamples + offset, firstPhase.doubleSamples + offset, firstPhase.length };
+        }
+        
+        // the longest pulse, a delayed high tick
+        int getMaximumLength() const noexcept { return _delayedHighTick.length; }
+        
+        
+    private:
+        
+        TickWaveform _highTick; // in the compile-time tables, or in the samples below
+        TickWaveform _lowTick;
+        TickWaveform _delayedHighTick; // first phase, the others follow it
+        TickWaveform _delayedLowTick;
+        
+        // the pulses computed by setSampleRate(), one after the other
+        std::vector<float> _floatSamples;
+        std::vector<double> _doubleSamples;
+    };
+};
@@ -0,0 +1,214 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "SyncSignalRenderer.h"
+
+
+using namespace juce;
+
+
+SyncSignalRenderer::SyncSignalRenderer(TempoMap& tempoMap)
+    : _tempoMap(tempoMap)
+{
+}
+
+
+void SyncSignalRenderer::prepare(double sampleRate, int maximumSamplesPerBlock)
+{
+    _sampleRate = sampleRate;
+    _maximumSamplesPerBlock = (unsigned int)maximumSamplesPerBlock;
+    
+    _ticksInBlock.resize(_maximumSamplesPerBlock + 1); // there can never be more than one tick per sample
+    _tickWaveforms.setSampleRate(_sampleRate);
+    
+    _minSamplesSinceLastTick = static_cast<unsigned int>(ceil(SyncSignal::minTickLengthInSeconds * _sampleRate)); // ceil for a tempo < 400.45
+    _maxSamplesSinceLastTick = static_cast<unsigned int>(floor(SyncSignal::maxTickLengthInSeconds * _sampleRate)); // floor for a tempo > 29.55
+    
+    // pulses start at least minSamplesSinceLastTick apart, so this is as many of them as can be heard at the same time
+    _voices.resize((unsigned int)_tickWaveforms.getMaximumLength() / _minSamplesSinceLastTick + 1);
+    _numVoices = 0;
+    _samplesSinceLastTick = _minSamplesSinceLastTick;
+    
+    _currentTickIndex = 0;
+}
+
+
+void SyncSignalRenderer::render(AudioBuffer<float>& buffer, int64_t startTimeInSamples, bool isPlaying) noexcept
+{
+    renderBlock(buffer, startTimeInSamples, isPlaying);
+}
+
+void SyncSignalRenderer::render(AudioBuffer<double>& buffer, int64_t startTimeInSamples, bool isPlaying) noexcept
+{
+    renderBlock(buffer, startTimeInSamples, isPlaying);
+}
+
+
+template <typename SampleType>
+void SyncSignalRenderer::renderBlock(AudioBuffer<SampleType>& buffer, int64_t startTimeInSamples, bool isPlaying) noexcept
+{
+    const auto numSamples = (unsigned int)(buffer.getNumSamples());
+    jassert (numSamples <= _maximumSamplesPerBlock);
+    
+    if (buffer.getNumChannels() <= 0 || numSamples == 0)
+        return;
+    
+    if (!isPlaying && !_sendSignalAlways) {
+        buffer.clear();
+        
+        // a tick cut by the end of the last block is not finished after the silence, its end alone would be taken as a tick
+        _numVoices = 0;
+        return;
+    }
+    
+    // the signal is rendered straight into the first channel, the other ones are a copy of it
+    SampleType* const output = buffer.getWritePointer (0);
+    
+    if (isPlaying)
+        renderSignal<SampleType, true>(output, numSamples, startTimeInSamples);
+    else
+        renderSignal<SampleType, false>(output, numSamples, startTimeInSamples);
+    
+    for (int c = 1; c < buffer.getNumChannels(); c++)
+        FloatVectorOperations::copy (buffer.getWritePointer (c), output, (int)numSamples);
+}
+
+
+template <typename SampleType, bool isPlaying>
+void SyncSignalRenderer::renderSignal(SampleType* output, unsigned int numSamples, int64_t startTimeInSamples) noexcept
+{
+    // the pulses are mixed into silence
+    FloatVectorOperations::clear (output, (int)numSamples);
+    
+    
+    // first the end of the pulses which did not fit in the last block
+    for (unsigned int v = 0 ; v < _numVoices ; ) {
+        Voice& voice = _voices[v];
+        const unsigned int length = std::min(numSamples, (unsigned int)voice.pulse.length - voice.position);
+        
+        FloatVectorOperations::add (output, voice.pulse.getSamples<SampleType>() + voice.position, (int)length);
+        voice.position += length;
+        
+        if (voice.position == (unsigned int)voice.pulse.length)
+            voice = _voices[--_numVoices];
+        else
+            v++;
+    }
+    
+    
+    unsigned int i = 0;
+    int64_t nextTick = 0;
+    bool lastTickRightBeforeABar = false;
+    int subSamplePosition = -1; // of the next tick, -1 if we do not know it
+    
+    // stopped: we keep sending the tempo and bar length of the current position
+    double tickLength = 0.0; // in seconds
+    unsigned int barLength = 0;
+    if constexpr (!isPlaying)
+        _tempoMap.getTickAndBarLengthAtPosition(startTimeInSamples, tickLength, barLength);
+    
+    double nextTickInSeconds = -(((double)(_samplesSinceLastTick))/_sampleRate); // we start at "minus samplesSinceLastTick" position
+    
+    
+    // playing: all the ticks of this block in one go, plus the first one after it (needed when we have to send a tick before it is due, see maxSamplesSinceLastTick)
+    int numTicks = 0;
+    int tickIdx = 0;
+    TempoMap::Tick tickAfterBlock { 0, false };
+    if constexpr (isPlaying)
+        numTicks = _tempoMap.getTicksInBlock(startTimeInSamples, startTimeInSamples + numSamples, _ticksInBlock.data(), (int)_ticksInBlock.size(), tickAfterBlock);
+    
+    const bool subSampleTicks = isPlaying && _tempoMap.getSubSampleTicks();
+    
+    
+    while (i < numSamples) {
+        
+        if constexpr (!isPlaying) {
+            nextTickInSeconds += tickLength;
+            nextTick = static_cast<int64_t>(nextTickInSeconds*_sampleRate);
+            
+            lastTickRightBeforeABar = false;
+            if (_currentTickIndex >= barLength-1)
+                lastTickRightBeforeABar = true;
+        }
+        else {
+            // ticks which we decided to ignore are skipped
+            while (tickIdx < numTicks && _ticksInBlock[tickIdx].position - startTimeInSamples < i)
+                tickIdx++;
+            
+            const TempoMap::Tick& tick = (tickIdx < numTicks) ? _ticksInBlock[tickIdx] : tickAfterBlock;
+            nextTick = tick.position - startTimeInSamples;
+            lastTickRightBeforeABar = tick.lastTickRightBeforeABar;
+            subSamplePosition = subSampleTicks ? tick.subSamplePosition : -1;
+        }
+        
+        // that last conditon (maxSamplesSinceLastTick) will make sure we always send ticks to a tempo >= 29.55bpm to maintain sync at all times
+        // (the silence until then in one go)
+        if (nextTick > i && _samplesSinceLastTick < _maxSamplesSinceLastTick) {
+            const auto silence = (unsigned int)std::min({ static_cast<int64_t>(numSamples - i), nextTick - i,
+                                                          static_cast<int64_t>(_maxSamplesSinceLastTick - _samplesSinceLastTick) });
+            i += silence;
+            _samplesSinceLastTick += silence;
+        }
+        
+        if (i < numSamples) {
+            if (_samplesSinceLastTick < _minSamplesSinceLastTick) { // sending this tick would mean tempo > 400.55bpm => losing sync on the Midronome
+                i++; // we ignore this tick and the loop above will move on to the next tick
+                _samplesSinceLastTick++;
+            }
+            else {
+                _currentTickIndex++;
+                if (lastTickRightBeforeABar)
+                    _currentTickIndex = 0;
+                
+                // a tick sent before it is due (see maxSamplesSinceLastTick) is not delayed to its sub-sample position
+                if (subSamplePosition >= 0 && nextTick == i)
+                    startVoice(output + i, numSamples - i, _tickWaveforms.getDelayedTick(lastTickRightBeforeABar, subSamplePosition));
+                else
+                    startVoice(output + i, numSamples - i, _tickWaveforms.getTick(lastTickRightBeforeABar));
+                
+                // the pulse goes on by itself, ticks due in the meantime are too close to this one anyway and will be ignored
+                i++;
+                _samplesSinceLastTick = 1;
+            }
+        }
+    }
+}
+
+
+template <typename SampleType>
+void SyncSignalRenderer::startVoice(SampleType* output, unsigned int numSamples, const SyncSignal::TickWaveform& pulse) noexcept
+{
+    const unsigned int lengthInBlock = std::min(numSamples, (unsigned int)pulse.length);
+    FloatVectorOperations::add (output, pulse.getSamples<SampleType>(), (int)lengthInBlock);
+    
+    if (lengthInBlock == (unsigned int)pulse.length)
+        return;
+    
+    // the pool is sized for the longest pulses sent as close as possible to each other, see prepare()
+    jassert (_numVoices < _voices.size());
+    if (_numVoices < _voices.size())
+        _voices[_numVoices++] = { pulse, lengthInBlock };
+}
@@ -0,0 +1,102 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "TempoMap.h"
+#include "SyncSignal.h"
+
+
+// The real-time part of the playback renderer: turns the ticks of a TempoMap into the sync signal, block after block, as
+// the host's transport moves. It knows nothing about ARA, so the exact same code can be driven without a DAW (see the
+// transport scripts of the MidroSync file generator).
+class SyncSignalRenderer
+{
+public:
+    SyncSignalRenderer(TempoMap& tempoMap);
+    
+    // resets the signal, as when the host (re)starts processing; tempoMap must be at the same sample rate
+    void prepare(double sampleRate, int maximumSamplesPerBlock);
+    
+    // Audio thread: renders the signal into every channel of buffer (at most maximumSamplesPerBlock samples), for a block
+    // starting at startTimeInSamples. Ticks are only taken from the tempo map while playing, otherwise we keep sending the
+    // current tempo if sendSignalAlways is set, or silence. A tick which does not fit in the block is finished in the next
+    // one, whatever its position, so that seeking or looping never cuts a tick. With sub-sample ticks (see
+    // TempoMap::setSubSampleTicks()), the pulses of the ticks are delayed to their exact position while playing.
+    // Both precisions give exactly the same signal, each from its own copy of the pulses.
+    void render(juce::AudioBuffer<float>& buffer, int64_t startTimeInSamples, bool isPlaying) noexcept;
+    void render(juce::AudioBuffer<double>& buffer, int64_t startTimeInSamples, bool isPlaying) noexcept;
+    
+    void setSendSignalAlways(bool val) { _sendSignalAlways = val; }
+    bool getSendSignalAlways() { return _sendSignalAlways; }
+    
+    
+private:
+    
+    template <typename SampleType>
+    void renderBlock(juce::AudioBuffer<SampleType>& buffer, int64_t startTimeInSamples, bool isPlaying) noexcept;
+    
+    // one channel of signal, while playing or while sending the signal when stopped: each case gets its own loop, without
+    // the tests of the other one
+    template <typename SampleType, bool isPlaying>
+    void renderSignal(SampleType* output, unsigned int numSamples, int64_t startTimeInSamples) noexcept;
+    
+    // mixes a pulse into output, what does not fit is kept in a voice for the next blocks
+    template <typename SampleType>
+    void startVoice(SampleType* output, unsigned int numSamples, const SyncSignal::TickWaveform& pulse) noexcept;
+    
+    
+    TempoMap& _tempoMap;
+    
+    double _sampleRate = 44100.0;
+    unsigned int _maximumSamplesPerBlock = 0;
+    
+    bool _sendSignalAlways = false;
+    
+    std::vector<TempoMap::Tick> _ticksInBlock; // sized in prepare() so that render() never allocates
+    SyncSignal::TickWaveforms _tickWaveforms; // same
+    
+    
+    // the pulses still being sent: they are simply added to the signal, so they can last longer than the space between two
+    // ticks (the pool is sized in prepare())
+    struct Voice {
+        SyncSignal::TickWaveform pulse; // in _tickWaveforms
+        unsigned int position; // next sample to send
+    };
+    
+    std::vector<Voice> _voices;
+    unsigned int _numVoices = 0;
+    
+    unsigned int _samplesSinceLastTick = 0; // to avoid sending two ticks "too close" to each other
+    unsigned int _minSamplesSinceLastTick = 0;
+    unsigned int _maxSamplesSinceLastTick = 0;
+    
+    unsigned int _currentTickIndex = 0;
+    
+    
+    JUCE_DECLARE_NON_COPYABLE (SyncSignalRenderer)
+};
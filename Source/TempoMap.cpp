@@ -25,60 +25,106 @@
 
 #include <JuceHeader.h>
 #include "TempoMap.h"
-
-
-double TempoMap::sampleRate = 44100.0;
-double TempoMap::halfASampleLength = 1.0/(44100.0*2.0);
+#if JucePlugin_Enable_ARA
+ #include "TickMapCache.h"
+#endif
 
 
 using namespace juce;
 
 
-TempoMap::TempoMap (ARADocument& document)
-    : _araDocument (document)
+#if JucePlugin_Enable_ARA
+TempoMap::TempoMap (TickMapCache& tickMapCache)
+    : _tickMapCache (&tickMapCache)
 {
-    if (_araDocument.getMusicalContexts().size() > 0)
-        selectMusicalContext (_araDocument.getMusicalContexts().front());
-    
-    _araDocument.addListener (this);
+    _tickMapCache->addTempoMap (*this);
 }
+#endif
 
-TempoMap::~TempoMap()
+TempoMap::TempoMap (const std::vector<TempoEntry>& tempoEntries, const std::vector<BarSignature>& barSignatures, double sampleRate)
+    : _sampleRate (sampleRate)
 {
-    _araDocument.removeListener (this);
-    selectMusicalContext (nullptr);
+    std::shared_ptr<const TickMap> tickMap = buildTickMap(tempoEntries, barSignatures, sampleRate, nullptr, [] { return false; });
+    
+    if (tickMap != nullptr) {
+        _tickMapSnapshot = new TickMapSnapshot { tickMap };
+        _tickMap = tickMap.get();
+        _publishedSampleRate = sampleRate;
+    }
 }
 
-    
-void TempoMap::didAddMusicalContextToDocument (ARADocument*, ARAMusicalContext* musicalContext)
+TempoMap::~TempoMap()
 {
-    if (_selectedMusicalContext == nullptr)
-        selectMusicalContext (musicalContext);
+#if JucePlugin_Enable_ARA
+    if (_tickMapCache != nullptr)
+        _tickMapCache->removeTempoMap (*this); // the TickMapCache thread does not publish anything to us anymore
+#endif
+    
+    // the audio thread is not running anymore at this point
+    delete _newTickMap.exchange (nullptr);
+    delete _tickMapSnapshot;
+    deleteOldTickMaps();
 }
 
-void TempoMap::willDestroyMusicalContext (ARAMusicalContext* musicalContext)
+
+void TempoMap::setSampleRate(double sampleRate)
 {
-    if (_selectedMusicalContext == musicalContext)
-        selectMusicalContext (nullptr);
+    if (sampleRate == _sampleRate.load())
+        return;
+    
+    jassert (_tickMapCache != nullptr); // the tick map built from the events given to the constructor stays at its sample rate
+    if (_tickMapCache == nullptr)
+        return;
+    
+    _tickMapPublished.reset();
+    _sampleRate = sampleRate;
+#if JucePlugin_Enable_ARA
+    _tickMapCache->sampleRateChanged();
+#endif
+    
+    // prepareToPlay() is not realtime, so we can wait for the TickMapCache thread (but not forever)
+    const double timeout = Time::getMillisecondCounterHiRes() + 1000.0;
+    
+    while (_publishedSampleRate.load() != sampleRate) {
+        const double remaining = timeout - Time::getMillisecondCounterHiRes();
+        if (remaining <= 0.0)
+            break;
+        
+        _tickMapPublished.wait (remaining);
+    }
 }
 
-void TempoMap::doUpdateMusicalContextContent (ARAMusicalContext* musicalContext, ARAContentUpdateScopes scopeFlags)
+void TempoMap::updateTickMap()
 {
-    if (_selectedMusicalContext != musicalContext)
-        selectMusicalContext (musicalContext);
-    else if (scopeFlags.affectTimeline())
-        rebuildTickMap();
+    TickMapSnapshot* newTickMap = _newTickMap.exchange (nullptr, std::memory_order_acq_rel);
+    
+    if (newTickMap == nullptr)
+        return;
+    
+    if (_tickMapSnapshot != nullptr) {
+        // we give the previous snapshot back to the TickMapCache thread, which will delete it
+        TickMapSnapshot* oldTickMaps = _oldTickMaps.load (std::memory_order_relaxed);
+        do {
+            _tickMapSnapshot->nextOldSnapshot = oldTickMaps;
+        } while (!_oldTickMaps.compare_exchange_weak (oldTickMaps, _tickMapSnapshot, std::memory_order_release, std::memory_order_relaxed));
+    }
+    
+    _tickMapSnapshot = newTickMap;
+    _tickMap = newTickMap->tickMap.get();
+    _cursorValid = false;
 }
 
+
 bool TempoMap::getTickAndBarLengthAtPosition(int64_t currentPos, double& tickLength, unsigned int& barLength) { // tick length in seconds
-    if (_tickMap.empty())
+    if (_tickMap == nullptr)
         return false;
     
-    auto it = std::upper_bound(_tickMap.begin(), _tickMap.end(), TickMapElement(((double)currentPos) / sampleRate));
-    if (it != _tickMap.begin()) // if we are already on the first element we stay, otherwise we take the one before
-        it--;
+    const std::vector<TickMapElement>& elements = _tickMap->elements;
     
-    tickLength = it->tickLength;
+    const TickPosition position = currentPos * (1 << tickPositionFractionBits);
+    auto it = elements.begin() + findElement(*_tickMap, position);
+    
+    tickLength = it->getTickLength(static_cast<int64_t>(it->getTicksFromStart(position))) / (tickPositionUnitsPerSample * _tickMap->sampleRate);
     barLength = it->barLength;
     
     return true;
@@ -86,301 +132,731 @@ bool TempoMap::getTickAndBarLengthAtPosition(int64_t currentPos, double& tickLen
 
 int64_t TempoMap::getNextTickPositionInSamples(int64_t currentPos, bool& lastTickRightBeforeABar)
 {
-    if (_tickMap.empty())
+    if (_tickMap == nullptr)
         return 0;
     
-    double currentPosInTime = ((double)currentPos) / sampleRate;
-    currentPosInTime -= _delay; // negative delay = currentPosInTime moves positively = tempo map shifted negatively (to the left)
+    TickPosition tickPos = 0;
+    size_t eltIdx = 0;
+    const TickPosition delayOffset = getDelayOffset();
+    const int64_t tickIdx = findNextTickIndex(*_tickMap, samplesToTickPosition(currentPos, delayOffset), eltIdx);
+    getTick(*_tickMap, tickIdx, eltIdx, tickPos, lastTickRightBeforeABar);
     
-    auto it = std::upper_bound(_tickMap.begin(), _tickMap.end(), TickMapElement(currentPosInTime));
+    return tickPositionToSamples(tickPos, delayOffset); // since the tempo map has not been shifted, we add the delay at the end
+}
+
+
+int TempoMap::getTicksInBlock(int64_t blockStart, int64_t blockEnd, Tick* ticks, int maxTicks, Tick& firstTickAfterBlock)
+{
+    if (_tickMap == nullptr) {
+        firstTickAfterBlock = {0, false}; // same as getNextTickPositionInSamples()
+        return 0;
+    }
     
-    if (it != _tickMap.begin()) // if we are already on the first element we stay, otherwise we take the one before
-        it--;
+    const TickPosition delayOffset = getDelayOffset();
     
+    if (!_cursorValid || blockStart != _cursorPosition || _cursorDelayOffset != delayOffset) {
+        // first block, transport jump, delay or sub-sample ticks change: we need to search
+        _cursorTickIdx = findNextTickIndex(*_tickMap, samplesToTickPosition(blockStart, delayOffset), _cursorElementIdx);
+        _cursorDelayOffset = delayOffset;
+        _cursorValid = true;
+    }
     
-    double tickPos = it->startPosition;
-    unsigned int tickIdx = it->tickOffset;
+    int numTicks = 0;
+    TickPosition tickPos = 0;
+    Tick tick;
     
-    if (sampleScaleLessThan(currentPosInTime, tickPos)) { // this could happen with a positive delay or when doing pre-roll (currentPos < 0)
-        while (sampleScaleLessThan(currentPosInTime, tickPos - it->tickLength)) {
-            tickPos -= it->tickLength; // we go backwards to send the signal during pre-roll or before a positive delay
-            if (tickIdx == 0)
-                tickIdx = it->barLength-1;
-            else
-                tickIdx--;
-        }
-    }
-    else {
-        while (sampleScaleLessThan(tickPos, currentPosInTime)) {
-            tickPos += it->tickLength;
-            tickIdx++;
-            if (tickIdx == it->barLength)
-                tickIdx = 0;
-        }
+    while (true) {
+        getTick(*_tickMap, _cursorTickIdx, _cursorElementIdx, tickPos, tick.lastTickRightBeforeABar);
+        tick.position = tickPositionToSamples(tickPos, delayOffset);
+        if (_subSampleTicks) // (the delay offset is then half a sample early, see getDelayOffset())
+            tick.subSamplePosition = static_cast<uint16_t>(tickPos + delayOffset + (1 << (tickPositionFractionBits-1))
+                                                           - tick.position * (1 << tickPositionFractionBits));
+        
+        if (tick.position >= blockEnd || numTicks == maxTicks)
+            break;
+        
+        ticks[numTicks++] = tick;
+        _cursorTickIdx++;
     }
     
-    lastTickRightBeforeABar = (tickIdx == (it->barLength-1));
+    firstTickAfterBlock = tick;
+    _cursorPosition = blockEnd;
     
-    return static_cast<int64_t>(round((tickPos + _delay) * sampleRate)); // since the tempo map has not been shifted, we add the delay at the end
+    return numTicks;
 }
 
 
+TempoMap::TickPosition TempoMap::getDelayOffset() const
+{
+    // negative delay = tempo map shifted negatively (to the left)
+    // With sub-sample ticks, we also shift it by half a sample to the left: the positions are then rounded down instead of
+    // to the nearest sample.
+    return toTickPosition(_delay, _tickMap->sampleRate) - (_subSampleTicks ? (1 << (tickPositionFractionBits-1)) : 0);
+}
 
 
-void TempoMap::selectMusicalContext (ARAMusicalContext* newSelectedMusicalContext)
+int64_t TempoMap::findNextTickIndex(const TickMap& tickMap, TickPosition time, size_t& eltIdx)
 {
-    if (auto oldContext = std::exchange (_selectedMusicalContext, newSelectedMusicalContext);
-        oldContext != _selectedMusicalContext)
-    {
-        if (oldContext != nullptr)
-            oldContext->removeListener (this);
-
-        if (_selectedMusicalContext != nullptr)
-            _selectedMusicalContext->addListener (this);
-    }
+    const std::vector<TickMapElement>& elements = tickMap.elements;
     
-    rebuildTickMap();
+    eltIdx = findElement(tickMap, time);
+    const TickMapElement& elt = elements[eltIdx];
+    
+    // before the first element (pre-roll or positive delay) this is negative, the tempo being constant there
+    const int64_t tickIdx = static_cast<int64_t>(elt.firstTickIndex) + elt.getFirstTickFrom(time);
+    
+    // past the last tick of the element, the next one is the first tick of the next element (which starts after time)
+    if (eltIdx+1 < elements.size() && tickIdx > static_cast<int64_t>(elements[eltIdx+1].firstTickIndex))
+        return static_cast<int64_t>(elements[eltIdx+1].firstTickIndex);
+    
+    return tickIdx;
 }
 
 
+void TempoMap::getTick(const TickMap& tickMap, int64_t tickIdx, size_t& eltIdx, TickPosition& tickPos, bool& lastTickRightBeforeABar)
+{
+    const std::vector<TickMapElement>& elements = tickMap.elements;
+    
+    // the element of a tick is the last one starting at or before it (the first one before all of them, the tempo is
+    // constant before the first element and after the last one)
+    auto moveToElementOf = [&elements] (size_t& idx, int64_t tick) {
+        while (idx+1 < elements.size() && tick >= static_cast<int64_t>(elements[idx+1].firstTickIndex))
+            idx++;
+        while (idx > 0 && tick < static_cast<int64_t>(elements[idx].firstTickIndex))
+            idx--;
+    };
+    
+    moveToElementOf(eltIdx, tickIdx);
+    const TickMapElement& elt = elements[eltIdx];
+    tickPos = elt.getTickPosition(tickIdx - static_cast<int64_t>(elt.firstTickIndex));
+    
+    // the tick is the last one before a bar if the next one starts a bar, which can be the first tick of the next element
+    size_t nextEltIdx = eltIdx;
+    moveToElementOf(nextEltIdx, tickIdx+1);
+    const TickMapElement& nextElt = elements[nextEltIdx];
+    
+    int64_t tickOffset = (static_cast<int64_t>(nextElt.tickOffset) + (tickIdx+1) - static_cast<int64_t>(nextElt.firstTickIndex)) % nextElt.barLength;
+    if (tickOffset < 0)
+        tickOffset += nextElt.barLength;
+    
+    lastTickRightBeforeABar = (tickOffset == 0);
+}
+
 
-void TempoMap::rebuildTickMap()
+double TempoMap::TickMapElement::getTicksFromStart(TickPosition time) const
 {
-    if (_selectedMusicalContext != nullptr)
-    {
-        // see documentation: ARA_SDK/ARA_Library/html_docs/group___model___timeline.html
-        const ARA::PlugIn::HostContentReader<ARA::kARAContentTypeTempoEntries> tempoReader (_selectedMusicalContext);
-        const ARA::PlugIn::HostContentReader<ARA::kARAContentTypeBarSignatures> barSigReader (_selectedMusicalContext);
-        
-        if (tempoReader && barSigReader && tempoReader.getEventCount() > 1 && barSigReader.getEventCount() > 0)
-        {
-            
+    const double distance = static_cast<double>(time - startPosition);
+    
+    if (distance <= 0.0 || tickLengthIncrement == 0.0)
+        return distance / tickLength;
+    
+    // n*tickLength + n*(n-1)/2*tickLengthIncrement = distance  <=>  (inc/2)*n^2 + (tickLength - inc/2)*n - distance = 0
+    // written as 2c / (-b - sqrt(b^2 - 4ac)) so that it also works with a tiny tickLengthIncrement
+    const double b = tickLength - tickLengthIncrement / 2.0;
+    const double discriminant = std::max(0.0, b*b + 2.0 * tickLengthIncrement * distance);
+    
+    return 2.0 * distance / (b + sqrt(discriminant));
+}
+
+int64_t TempoMap::TickMapElement::getFirstTickFrom(TickPosition time) const
+{
+    int64_t tick = static_cast<int64_t>(ceil(getTicksFromStart(time)));
+    
+    // the tick positions are rounded, so the tick right next to time can be on the other side of it
+    while (getTickPosition(tick-1) >= time)
+        tick--;
+    while (getTickPosition(tick) < time)
+        tick++;
+    
+    return tick;
+}
+
+
+
+
+std::unique_ptr<TempoMap::TickMap> TempoMap::buildTickMap(const std::vector<TempoEntry>& tempoEntries,
+                                                          const std::vector<BarSignature>& barSignatures,
+                                                          double sampleRate,
+                                                          const TickMap* previousTickMap,
+                                                          const std::function<bool()>& shouldCancel)
+{
+    if (tempoEntries.size() < 2 || barSignatures.empty())
+        return nullptr;
+    
+    const double unitsPerSecond = sampleRate * tickPositionUnitsPerSample;
+    const TickPosition onTickTolerance = toTickPosition(onTickToleranceInSeconds, sampleRate);
+    const TickPosition rampTolerance = toTickPosition(rampToleranceInSeconds, sampleRate);
+    
 #ifdef DEBUG
-            std::stringstream stream;
-            stream.precision(6);
-            stream << std::fixed << "\n\n";
-            for (ARA::ARAInt32 i = 0 ; i < tempoReader.getEventCount() ; i++)
-                stream  << "tempo:       time=" << tempoReader[i].timePosition << "     quarter=" << tempoReader[i].quarterPosition << "\n";
-            stream << "\n\n";
-            
-            for (ARA::ARAInt32 i = 0 ; i < barSigReader.getEventCount() ; i++)
-                stream  << "barSig:   quarter=" << barSigReader[i].position << "      " << barSigReader[i].numerator << "/" << barSigReader[i].denominator << "\n";
-                            
-            std::cout << "\n--------------------------------\n------ ORG DATA: -----\n" << stream.str() << "\n\n";
+    std::stringstream stream;
+    stream.precision(6);
+    stream << std::fixed << "\n\n";
+    for (int i = 0 ; i < (int)tempoEntries.size() ; i++)
+        stream  << "tempo:       time=" << tempoEntries[i].timePosition << "     quarter=" << tempoEntries[i].quarterPosition << "\n";
+    stream << "\n\n";
+    
+    for (int i = 0 ; i < (int)barSignatures.size() ; i++)
+        stream  << "barSig:   quarter=" << barSignatures[i].position << "      " << barSignatures[i].numerator << "/" << barSignatures[i].denominator << "\n";
+                    
+    std::cout << "\n--------------------------------\n------ ORG DATA: -----\n" << stream.str() << "\n\n";
 #endif
-            
-            
-            
-            /* -------- STEP 1 ---------
-             * we build a temporary vector of time signature changes containing {quarterPosition, barLength (in ticks)}
-             * we also check they all are on a bar -> if not we "quantize" them
-             */
-            struct TimeSigChange { unsigned int quarterPosition; unsigned int barLength; };
-            std::vector<TimeSigChange> timeSigChanges;
-            unsigned int previousQuartersPerBar = 0;
-            unsigned int previousQuarterPos = 0;
-            for (ARA::ARAInt32 i = 0 ; i < barSigReader.getEventCount() ; i++) {
-                unsigned int quartersPerBar = (4 * barSigReader[i].numerator) / barSigReader[i].denominator;
-                unsigned int quarterPos = static_cast<unsigned int>(round(barSigReader[i].position));
-                
-                if (quartersPerBar == 0)
-                    quartersPerBar = 1; // in case of very tiny time signatures like 1/8 or 1/16, etc => we change it to 1/4
-                
-                if (previousQuartersPerBar != 0) {
-                    unsigned int remainder = (quarterPos - previousQuarterPos) % previousQuartersPerBar;
-                    if (remainder != 0)
-                        quarterPos += previousQuartersPerBar - remainder; // we quantize to the next bar
-                }
-                
-                timeSigChanges.push_back({quarterPos, 24 * quartersPerBar});
-                
-                previousQuartersPerBar = quartersPerBar;
-                previousQuarterPos = quarterPos;
+    
+    
+    
+    /* -------- STEP 1 ---------
+     * we build a temporary vector of time signature changes containing {quarterPosition, barLength (in ticks)}
+     * we also check they all are on a bar -> if not we "quantize" them
+     */
+    struct TimeSigChange { unsigned int quarterPosition; unsigned int barLength; };
+    std::vector<TimeSigChange> timeSigChanges;
+    unsigned int previousQuartersPerBar = 0;
+    unsigned int previousQuarterPos = 0;
+    for (int i = 0 ; i < (int)barSignatures.size() ; i++) {
+        unsigned int quartersPerBar = (4 * barSignatures[i].numerator) / barSignatures[i].denominator;
+        unsigned int quarterPos = static_cast<unsigned int>(round(barSignatures[i].position));
+        
+        if (quartersPerBar == 0)
+            quartersPerBar = 1; // in case of very tiny time signatures like 1/8 or 1/16, etc => we change it to 1/4
+        
+        if (previousQuartersPerBar != 0) {
+            if (quarterPos <= previousQuarterPos) {
+                // the previous change was quantized onto (or past) this one, which then replaces it
+                quarterPos = previousQuarterPos;
+                timeSigChanges.pop_back();
             }
-            
-            
-            
-            /* -------- STEP 2 ---------
-             * we build another temporary array of the tempo changes, also adapting them
-             *     -> if a tempo change is between 2 ticks, it needs to be made into 2 tempo changes so they are on the ticks
-             */
-            struct TempoChange { double timePosition; double tickLength; };
-            std::vector<TempoChange> tempoChanges;
-            double nextPosition = tempoReader[0].timePosition;
-            for (ARA::ARAInt32 i = 0 ; i < tempoReader.getEventCount()-1 ; i++) {
-                
-                /*
-                 * Math:
-                 *   diff(xxxPos)        = tempoEntries[i+1].xxxPosition - tempoEntries[i].xxxPosition
-                 *   quartersPerSecond   = diff(quarterPos) / diff(timePos)
-                 *   quarterLength       = diff(timePos) / diff(quarterPos) = 1/quartersPerSecond
-                 *   tickLength          = quarterLength / 24
-                 *   quarterPos(timePos) = (timePos - timePosBeginning)       / quarterLength + quarterPosBeginning
-                 *   timePos(quarterPos) = (quarterPos - quarterPosBeginning) * quarterLength + timePosBeginning
-                 */
-                
-                
-                double tickLength = ((tempoReader[i+1].timePosition - tempoReader[i].timePosition)
-                                        / (tempoReader[i+1].quarterPosition - tempoReader[i].quarterPosition))
-                                        / 24.0;
-                
-                double currentPosition = nextPosition;
-                
-                tempoChanges.push_back({currentPosition, tickLength});
-                
-                if (i == tempoReader.getEventCount()-2) // if i+1 is the last tempoEntry, then we do not care about nextPosition, we're done
-                    break;
-                
-                nextPosition = tempoReader[i+1].timePosition;
-                
-                double lastTickPos = currentPosition;
-                while (sampleScaleLessThan(lastTickPos, nextPosition))
-                    lastTickPos += tickLength;
-                
-                // Testing in Studio One 4, it seems all tempo changes are at least 200ms apart, so we never have multiple tempo changes between 2 ticks (83ms at 30bpm)
-                // maybe other DAWs can make more tempo changes, then the code below would not work...
-                if (!sampleScaleEquals(lastTickPos, nextPosition)) {
-                    // that means the tempo change does not fall "on" a tick, so we make this into 2 tempo changes, both on ticks
-                    
-                    // this one tick tempo change will have a tickLength of partially this tempo and partially the next tempo
-                    double nextTickLength = ((tempoReader[i+2].timePosition - tempoReader[i+1].timePosition)
-                                            / (tempoReader[i+2].quarterPosition - tempoReader[i+1].quarterPosition))
-                                            / 24.0;
-                    double percentOfNextTickLength = (lastTickPos - nextPosition) / tickLength;
-                    double newTickLength = (nextTickLength * percentOfNextTickLength) + (tickLength * (1 - percentOfNextTickLength));
-                    
-                    tempoChanges.push_back({lastTickPos-tickLength, newTickLength});
-                    
-                    nextPosition = lastTickPos-tickLength+newTickLength;
-                }
+            else {
+                unsigned int remainder = (quarterPos - previousQuarterPos) % previousQuartersPerBar;
+                if (remainder != 0)
+                    quarterPos += previousQuartersPerBar - remainder; // we quantize to the next bar
             }
+        }
+        
+        timeSigChanges.push_back({quarterPos, 24 * quartersPerBar});
+        
+        previousQuartersPerBar = quartersPerBar;
+        previousQuarterPos = quarterPos;
+    }
+    
+    
+    
+    /* -------- STEP 2 ---------
+     * we build another temporary array of the tempo changes, also adapting them so they are all on ticks
+     *     -> tick n is on quarter tempoEntries[0].quarterPosition + n/24, and between 2 tempo entries the time is linear in quarters
+     *     -> a tempo entry which falls on a tick gives a tempo change there
+     *     -> when one or more tempo entries fall between 2 ticks (e.g. a tempo ramp written as dense automation by the host),
+     *        the first of these 2 ticks gets a one tick tempo change which brings it exactly to the second one
+     */
+    struct TempoChange { TickPosition timePosition; double tickLength; double tickLengthIncrement; int64_t tick; }; // lengths in TickPosition units
+    std::vector<TempoChange> tempoChanges;
+    
+    /*
+     * Math:
+     *   diff(xxxPos)        = tempoEntries[i+1].xxxPosition - tempoEntries[i].xxxPosition
+     *   quartersPerSecond   = diff(quarterPos) / diff(timePos)
+     *   quarterLength       = diff(timePos) / diff(quarterPos) = 1/quartersPerSecond
+     *   tickLength          = quarterLength / 24
+     *   quarterPos(timePos) = (timePos - timePosBeginning)       / quarterLength + quarterPosBeginning
+     *   timePos(quarterPos) = (quarterPos - quarterPosBeginning) * quarterLength + timePosBeginning
+     */
+    auto tickLengthOfSegment = [&tempoEntries, unitsPerSecond] (size_t i) { // segment i = from tempoEntries[i] to tempoEntries[i+1]
+        return ((tempoEntries[i+1].timePosition - tempoEntries[i].timePosition)
+                    / (tempoEntries[i+1].quarterPosition - tempoEntries[i].quarterPosition))
+                    / 24.0 * unitsPerSecond;
+    };
+    
+    auto tickAtQuarter = [&tempoEntries] (double quarterPos) { // not rounded
+        return (quarterPos - tempoEntries[0].quarterPosition) * 24.0;
+    };
+    
+    auto tickPosition = [&tempoEntries, sampleRate] (size_t i, int64_t tick) { // the tick must be in segment i (or after it if it is the last one)
+        const double quarterPos = tempoEntries[0].quarterPosition + (double)tick / 24.0;
+        return toTickPosition(tempoEntries[i].timePosition + (quarterPos - tempoEntries[i].quarterPosition)
+                                * (tempoEntries[i+1].timePosition - tempoEntries[i].timePosition)
+                                / (tempoEntries[i+1].quarterPosition - tempoEntries[i].quarterPosition), sampleRate);
+    };
+    
+    // An entry this close to a tick (see onTickTolerance) is considered to be on it. The tick is then computed with the tempo
+    // after the entry and ends the tempo before it, so it must be this close to the entry with both tempos (in ticks, the
+    // tolerance of the slowest one).
+    auto onTickToleranceAtEntry = [&] (size_t i) { // entry i+1, between segments i and i+1
+        return onTickTolerance / std::max(tickLengthOfSegment(i), tickLengthOfSegment(i+1));
+    };
+    
+    // the segment containing a tick, an entry on the tick starts the segment
+    const size_t lastSegment = tempoEntries.size() - 2;
+    auto findSegment = [&] (size_t i, int64_t tick) { // from segment i, which must not be after the tick
+        while (i < lastSegment && tickAtQuarter(tempoEntries[i+1].quarterPosition) <= (double)tick + onTickToleranceAtEntry(i))
+            i++;
+        return i;
+    };
+    
+    // each segment and each tick is visited once, so this stays linear in the amount of tempo entries
+    size_t segment = 0;
+    int64_t tick = 0;
+    while (true) {
+        
+        if (shouldCancel())
+            return nullptr;
+        
+        segment = findSegment(segment, tick);
+        
+        const TickPosition tickPos = tickPosition(segment, tick);
+        const double tickLength = tickLengthOfSegment(segment);
+        
+        if (segment == lastSegment) { // the tempo does not change anymore, we're done
+            tempoChanges.push_back({tickPos, tickLength, 0.0, tick});
+            break;
+        }
+        
+        // first tick at or after the next tempo entry
+        const double entryTick = tickAtQuarter(tempoEntries[segment+1].quarterPosition);
+        const double tolerance = onTickToleranceAtEntry(segment);
+        const int64_t nextTick = static_cast<int64_t>(ceil(entryTick - tolerance));
+        
+        if ((double)nextTick - entryTick <= tolerance) {
+            // the tempo entry is on a tick, the tempo is constant up to it
+            tempoChanges.push_back({tickPos, tickLength, 0.0, tick});
+            tick = nextTick;
+            continue;
+        }
+        
+        // the tempo entry (and possibly the ones after it) are between 2 ticks: the tempo is constant up to the first one,
+        // which then needs its own tick length to land on the second one
+        const int64_t straddlingTick = nextTick - 1;
+        TickPosition straddlingTickPos = tickPos;
+        
+        if (straddlingTick > tick) {
+            tempoChanges.push_back({tickPos, tickLength, 0.0, tick});
+            straddlingTickPos = tickPosition(segment, straddlingTick);
+        }
+        
+        segment = findSegment(segment+1, nextTick);
+        
+        tempoChanges.push_back({straddlingTickPos, (double)(tickPosition(segment, nextTick) - straddlingTickPos), 0.0, straddlingTick});
+        tick = nextTick;
+    }
+    
+    
+    // A tempo ramp from the host is a series of tempo entries (the tempo is constant between 2 entries), which gives us a tempo
+    // change on almost every tick. We merge the consecutive tempo changes whose ticks all are within rampTolerance of a tick
+    // length changing by the same amount on each tick into one tempo ramp (computed directly, see TickMapElement::getTickPosition()).
+    auto rampFits = [&tempoChanges, rampTolerance] (const TempoChange& ramp, size_t i) { // checks the ticks of tempoChanges[i], up to the next one
+        TickMapElement rampElt (ramp.timePosition, ramp.tickLength);
+        rampElt.tickLengthIncrement = ramp.tickLengthIncrement;
+        
+        const TempoChange& change = tempoChanges[i];
+        const TempoChange& nextChange = tempoChanges[i+1];
+        
+        if (rampElt.getTickLength(nextChange.tick - ramp.tick) <= 0.0) // a ramp slowing down can only go so far
+            return false;
+        
+        if (std::abs(rampElt.getTickPosition(nextChange.tick - ramp.tick) - nextChange.timePosition) > rampTolerance)
+            return false;
+        
+        auto tickMoves = [&] (int64_t tick) {
+            const TickPosition tickPos = change.timePosition + static_cast<TickPosition>(llround((double)(tick - change.tick) * change.tickLength));
+            return std::abs(rampElt.getTickPosition(tick - ramp.tick) - tickPos) > rampTolerance;
+        };
+        
+        // The distance between the ramp and the constant tempo of the change is a parabola in the tick, so over the ticks of the
+        // change it is the largest at either end or next to the top of the parabola: that is all we check, whatever the amount
+        // of ticks in between (only the rounding of the positions, a fraction of a TickPosition unit, is not followed exactly).
+        const int64_t firstTick = change.tick + 1;
+        const int64_t lastTick = nextChange.tick - 1;
+        if (firstTick > lastTick)
+            return true;
+        
+        if (tickMoves(firstTick) || tickMoves(lastTick))
+            return false;
+        
+        if (ramp.tickLengthIncrement != 0.0) {
+            // the slopes are the same there: tickLength + (n - 1/2) * tickLengthIncrement = change.tickLength
+            const double topTick = (double)ramp.tick + (change.tickLength - ramp.tickLength) / ramp.tickLengthIncrement + 0.5;
             
+            if (topTick > (double)firstTick && topTick < (double)lastTick) {
+                const int64_t tick = static_cast<int64_t>(floor(topTick));
+                if (tickMoves(tick) || tickMoves(tick+1))
+                    return false;
+            }
+        }
+        
+        return true;
+    };
+    
+    std::vector<TempoChange> rampedTempoChanges;
+    for (size_t i = 0 ; i < tempoChanges.size() ; ) {
+        
+        if (shouldCancel())
+            return nullptr;
+        
+        TempoChange ramp = tempoChanges[i];
+        size_t next = i + 1;
+        
+        // the last tempo change goes on forever, so it is never part of a ramp
+        if (next+1 < tempoChanges.size()) {
+            // the tick length increment which brings the ramp exactly on the tempo change after the next one
+            const TempoChange& target = tempoChanges[next+1];
+            const double n = (double)(target.tick - ramp.tick); // >= 2
+            ramp.tickLengthIncrement = 2.0 * ((double)(target.timePosition - ramp.timePosition) - n * ramp.tickLength) / (n * (n - 1.0));
             
+            if (rampFits(ramp, i)) {
+                while (next+1 < tempoChanges.size() && rampFits(ramp, next))
+                    next++;
+            }
             
-            /* -------- STEP 3 ---------
-             * we now have:
-             *      -> a list of tempo changes which all are on a tick
-             *      -> a list of time signature changes which are all on a bar
-             * so we can finally build our _tickMap
-             */
-            
-            _tickMap.clear();
-            int timeSigChangeIdx = 0;
-            double tickPos = 0; // we assume tempoChanges[0].timePosition = 0
-            unsigned int tickIdx = 0; // same
-            unsigned int tickOffset = 0;
+            if (next == i+1) // nothing merged
+                ramp.tickLengthIncrement = 0.0;
+        }
+        
+        rampedTempoChanges.push_back(ramp);
+        i = next;
+    }
+    
+    tempoChanges.swap(rampedTempoChanges);
+    
+    
+    
+    /* -------- STEP 3 ---------
+     * we now have:
+     *      -> a list of tempo changes which all are on a tick
+     *      -> a list of time signature changes which are all on a bar
+     * so we can finally build our tick map (off to the side, the audio thread only gets it once it is complete)
+     */
+    
+    auto newTickMap = std::make_unique<TickMap>();
+    newTickMap->sampleRate = sampleRate;
+    std::vector<TickMapElement>& tickMap = newTickMap->elements;
+    int timeSigChangeIdx = 0;
+    TickPosition tickPos = 0; // we assume tempoChanges[0].timePosition = 0
+    unsigned int tickIdx = 0; // same
+    
+    // tickPos is always computed from the last tempo change (and not from the previous tickPos), so that the rounding errors
+    // do not build up over the time signature changes (and so that we can follow tempo ramps)
+    TickMapElement tempoChangeElt;
+    unsigned int tempoChangeTickIdx = 0;
+    unsigned int tickOffset = 0;
+    
+    for (int i = 0 ; i < tempoChanges.size() ; i++) {
+        
+        if (shouldCancel())
+            return nullptr;
+        
+        TickPosition nextTempoChangePos = tempoChanges[i].timePosition;
+        
+        // if this is not the first tempo change, we check if there were any time signature changes since the last tempo change
+        if (!tickMap.empty()) {
+            TickMapElement lastElt = tickMap.back();
             
-            for (int i = 0 ; i < tempoChanges.size() ; i++) {
-                
-                double nextTempoChangePos = tempoChanges[i].timePosition;
-                
-                // if this is not the first tempo change, we check if there were any time signature changes since the last tempo change
-                if (!_tickMap.empty()) {
-                    TickMapElement lastElt = _tickMap.back();
-                    
-                    while (sampleScaleLessThan(tickPos, nextTempoChangePos)) {
-                        if (timeSigChangeIdx+1 < timeSigChanges.size()) {
-                            while (sampleScaleLessThan(tickPos, nextTempoChangePos) && tickIdx < (timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24) {
-                                tickPos += lastElt.tickLength;
-                                tickIdx++;
-                                tickOffset++;
-                                if (tickOffset == lastElt.barLength)
-                                    tickOffset = 0;
-                            }
-                            
-                            if (sampleScaleLessThan(tickPos, nextTempoChangePos)) {
-                                // this means we have tickIdx == 24*timeSigChanges[timeSigChangeIdx+1].quarterPosition
-                                // => we add a change for the new time signature here
-                                
-                                timeSigChangeIdx++;
-                                
-                                TickMapElement newElt;
-                                newElt.startPosition = tickPos;
-                                newElt.tickLength = lastElt.tickLength;
-                                newElt.tickOffset = 0; // = tickIdx
-                                newElt.barLength = timeSigChanges[timeSigChangeIdx].barLength;
-                                
-                                _tickMap.push_back(newElt);
-                                lastElt = _tickMap.back();
-                            }
-                        }
-                        else { // if we are here it means there are no more time sig changes, we loop to update tickPos and tickOffset
-                            tickPos += lastElt.tickLength;
-                            tickIdx++;
-                            tickOffset++;
-                            if (tickOffset == lastElt.barLength)
-                                tickOffset = 0;
-                        }
-                    }
-                }
-                
+            while (nextTempoChangePos - tickPos > onTickTolerance) {
+                int64_t ticksToTempoChange = ticksToReach(tempoChangeElt, tickIdx - tempoChangeTickIdx, nextTempoChangePos, onTickTolerance);
                 
-                TickMapElement elt;
-                elt.startPosition = nextTempoChangePos; // should be = tickPos at this point
-                elt.tickLength = tempoChanges[i].tickLength;
-                elt.tickOffset = tickOffset;
+                // if there is a time signature change before the tempo change, we only go up to it
+                int64_t ticksToTimeSigChange = -1;
+                if (timeSigChangeIdx+1 < timeSigChanges.size())
+                    ticksToTimeSigChange = std::max((int64_t)0, (int64_t)(timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24 - (int64_t)tickIdx);
                 
-                // if both conditions: (microPrecisionLessThan(tickPos, nextTempoChangePos) && tickIdx < (timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24)
-                // in the loop above become false at the same time, then it means we have a time signature change precisely on this tempo change
-                if (timeSigChangeIdx+1 < timeSigChanges.size() && tickIdx == (timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24)
-                    timeSigChangeIdx++;
+                const bool timeSigChangeFirst = (ticksToTimeSigChange >= 0 && ticksToTimeSigChange < ticksToTempoChange);
+                const int64_t ticks = timeSigChangeFirst ? ticksToTimeSigChange : ticksToTempoChange;
                 
-                elt.barLength = timeSigChanges[timeSigChangeIdx].barLength;
+                tickIdx += (unsigned int)ticks;
+                tickPos = tempoChangeElt.getTickPosition(tickIdx - tempoChangeTickIdx);
+                tickOffset = (unsigned int)((tickOffset + ticks) % lastElt.barLength);
                 
-                _tickMap.push_back(elt);
-            }
-            
-            
-            
-            /* -------- STEP 4 ---------
-             * in case there are time signature changes after the last tempo change, we add them
-             */
-            while (timeSigChangeIdx+1 < timeSigChanges.size()) {
-                TickMapElement lastElt = _tickMap.back(); // at this point we know there is at least one element in _tickMap
-                
-                while (tickIdx < (timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24) {
-                    tickPos += lastElt.tickLength;
-                    tickIdx++;
-                }
+                if (!timeSigChangeFirst)
+                    break; // we are on the tempo change (if a time signature change is also here, it is handled below)
                 
-                // this means we have tickIdx*24 == timeSigChanges[timeSigChangeIdx+1].quarterPosition
+                // this means we have tickIdx == 24*timeSigChanges[timeSigChangeIdx+1].quarterPosition
                 // => we add a change for the new time signature here
                 
                 timeSigChangeIdx++;
+                tickOffset = 0; // a time signature change is always on a bar
                 
                 TickMapElement newElt;
                 newElt.startPosition = tickPos;
-                newElt.tickLength = lastElt.tickLength;
-                newElt.tickOffset = 0; // = tickOffset (if it had been updated)
+                newElt.tickLength = tempoChangeElt.getTickLength(tickIdx - tempoChangeTickIdx);
+                newElt.tickLengthIncrement = tempoChangeElt.tickLengthIncrement;
+                newElt.tickOffset = 0; // = tickIdx
                 newElt.barLength = timeSigChanges[timeSigChangeIdx].barLength;
                 
-                _tickMap.push_back(newElt);
-                lastElt = _tickMap.back();
+                tickMap.push_back(newElt);
+                lastElt = tickMap.back();
             }
-            
-            
-            
-            //_tickMap.push_back(TickMapElement(0.0, 0.020, 24*4));  // 125bpm 4/4
-            //_tickMap.push_back(TickMapElement(7.68, 0.010, 24*3)); // after 4 bars, 250bpm 3/4
-            
-            
+        }
+        
+        
+        // if ticksToTimeSigChange == ticksToTempoChange in the loop above, then it means we have a time signature change precisely on this tempo change
+        if (timeSigChangeIdx+1 < timeSigChanges.size() && tickIdx == (timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24) {
+            timeSigChangeIdx++;
+            tickOffset = 0;
+        }
+        
+        TickMapElement elt;
+        elt.startPosition = nextTempoChangePos; // should be = tickPos at this point
+        elt.tickLength = tempoChanges[i].tickLength;
+        elt.tickLengthIncrement = tempoChanges[i].tickLengthIncrement;
+        elt.tickOffset = tickOffset;
+        elt.barLength = timeSigChanges[timeSigChangeIdx].barLength;
+        
+        tickMap.push_back(elt);
+        
+        tempoChangeElt = elt;
+        tempoChangeTickIdx = tickIdx;
+    }
+    
+    
+    
+    /* -------- STEP 4 ---------
+     * in case there are time signature changes after the last tempo change, we add them
+     */
+    while (timeSigChangeIdx+1 < timeSigChanges.size()) {
+        if (shouldCancel())
+            return nullptr;
+        
+        if (tickIdx < (timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24) {
+            tickIdx = (timeSigChanges[timeSigChangeIdx+1].quarterPosition)*24;
+            tickPos = tempoChangeElt.getTickPosition(tickIdx - tempoChangeTickIdx);
+        }
+        
+        // this means we have tickIdx*24 == timeSigChanges[timeSigChangeIdx+1].quarterPosition
+        // => we add a change for the new time signature here
+        
+        timeSigChangeIdx++;
+        
+        TickMapElement newElt;
+        newElt.startPosition = tickPos;
+        newElt.tickLength = tempoChangeElt.getTickLength(tickIdx - tempoChangeTickIdx);
+        newElt.tickLengthIncrement = tempoChangeElt.tickLengthIncrement;
+        newElt.tickOffset = 0; // = tickOffset (if it had been updated)
+        newElt.barLength = timeSigChanges[timeSigChangeIdx].barLength;
+        
+        tickMap.push_back(newElt);
+    }
+    
+    
+    
+    //tickMap.push_back(TickMapElement(0.0, 0.020, 24*4));  // 125bpm 4/4
+    //tickMap.push_back(TickMapElement(7.68, 0.010, 24*3)); // after 4 bars, 250bpm 3/4
+    
+    
+    
+    /* -------- STEP 5 ---------
+     * we number the ticks of each element and build the search tree, the ticks themselves are computed when they are needed
+     */
+    numberTicks(*newTickMap);
+    
+    buildSearchTree(*newTickMap);
+    
+    // everything before the first element which changed is the same as in the previous tick map, except for the ticks of
+    // the element right before it (they depend on where the next element starts)
+    if (previousTickMap != nullptr) {
+        const std::vector<TickMapElement>& previousElements = previousTickMap->elements;
+        
+        size_t i = 0;
+        while (i < tickMap.size() && i < previousElements.size() && tickMap[i].sameTicksAs(previousElements[i]))
+            i++;
+        
+        newTickMap->unchangedElements = (i > 0) ? i-1 : 0;
+    }
+    
+    
 #ifdef DEBUG
-            stream.str("");
-            for (auto i : _tickMap)
-                stream  << "@" << i.startPosition << ":     tickLen=" << i.tickLength << "     barLen="
-                        << i.barLength << "     tickOffset=" << i.tickOffset << "\n";
-            
-            stream << "\n";
-            
-            for (auto i : _tickMap)
-                stream << "@" << i.startPosition << ":   " << (1.0/(i.tickLength * 24.0)) * 60.0 << " BPM (" << i.barLength/24 << "/4)\n";
+    stream.str("");
+    for (auto i : tickMap)
+        stream  << "@" << i.startPosition / unitsPerSecond << ":     tickLen=" << i.tickLength / unitsPerSecond << "     tickLenIncrement="
+                << i.tickLengthIncrement / unitsPerSecond << "     barLen="
+                << i.barLength << "     tickOffset=" << i.tickOffset << "\n";
+    
+    stream << "\n";
+    
+    for (auto i : tickMap)
+        stream << "@" << i.startPosition / unitsPerSecond << ":   " << (unitsPerSecond/(i.tickLength * 24.0)) * 60.0 << " BPM (" << i.barLength/24 << "/4)\n";
 
-            std::cout << "------ TickMap: -----\n\n" << stream.str() << "\n";
+    std::cout << "------ TickMap: -----\n\n" << stream.str() << "\n";
+    std::cout << "------ " << newTickMap->unchangedElements << " elements unchanged -----\n\n";
 #endif
+    
+    
+    return newTickMap;
+}
+
+
+
+void TempoMap::numberTicks(TickMap& tickMap)
+{
+    std::vector<TickMapElement>& elements = tickMap.elements;
+    const TickPosition onTickTolerance = toTickPosition(onTickToleranceInSeconds, tickMap.sampleRate);
+    
+    // one search per element (see ticksToReach()), the ticks in between are never visited
+    size_t numTicks = 0;
+    for (size_t i = 0 ; i < elements.size() ; i++) {
+        elements[i].firstTickIndex = numTicks;
+        
+        if (i+1 < elements.size())
+            numTicks += static_cast<size_t>(ticksToReach(elements[i], 0, elements[i+1].startPosition, onTickTolerance));
+    }
+}
+
+
+void TempoMap::writeTickMap(const TickMap& tickMap, OutputStream& output)
+{
+    output.writeDouble(tickMap.sampleRate);
+    output.writeInt(static_cast<int>(tickMap.elements.size()));
+    
+    for (const TickMapElement& elt : tickMap.elements) {
+        output.writeInt64(elt.startPosition);
+        output.writeDouble(elt.tickLength);
+        output.writeDouble(elt.tickLengthIncrement);
+        output.writeInt(static_cast<int>(elt.barLength));
+        output.writeInt(static_cast<int>(elt.tickOffset));
+    }
+}
+
+
+std::unique_ptr<TempoMap::TickMap> TempoMap::readTickMap(InputStream& input)
+{
+    constexpr int64 bytesPerElement = 8 + 8 + 8 + 4 + 4;
+    
+    auto tickMap = std::make_unique<TickMap>();
+    tickMap->sampleRate = input.readDouble();
+    const int numElements = input.readInt();
+    
+    if (!(tickMap->sampleRate > 0.0) || numElements <= 0 || numElements > input.getNumBytesRemaining() / bytesPerElement)
+        return nullptr;
+    
+    std::vector<TickMapElement>& elements = tickMap->elements;
+    elements.resize(static_cast<size_t>(numElements));
+    
+    for (TickMapElement& elt : elements) {
+        elt.startPosition = input.readInt64();
+        elt.tickLength = input.readDouble();
+        elt.tickLengthIncrement = input.readDouble();
+        elt.barLength = static_cast<unsigned int>(input.readInt());
+        elt.tickOffset = static_cast<unsigned int>(input.readInt());
+    }
+    
+    // the same checks as what buildTickMap() guarantees, so that the ticks computed from the elements cannot go wrong
+    if (elements.back().tickLengthIncrement != 0.0) // the tempo is constant after the last element
+        return nullptr;
+    
+    for (size_t i = 0 ; i < elements.size() ; i++) {
+        const TickMapElement& elt = elements[i];
+        
+        if (!(elt.tickLength > 0.0) || !std::isfinite(elt.tickLengthIncrement) || elt.barLength == 0 || elt.tickOffset >= elt.barLength)
+            return nullptr;
+        
+        if (i+1 < elements.size()) {
+            const TickPosition nextStart = elements[i+1].startPosition;
+            if (nextStart <= elt.startPosition)
+                return nullptr;
             
+            // a tempo ramp slowing down must still reach the next element
+            const double ticks = elt.getTicksFromStart(nextStart);
+            if (!std::isfinite(ticks) || !(elt.getTickLength(static_cast<int64_t>(ceil(ticks))) > 0.0))
+                return nullptr;
         }
     }
+    
+    numberTicks(*tickMap);
+    buildSearchTree(*tickMap);
+    
+    return tickMap;
 }
 
 
- 
+void TempoMap::buildSearchTree(TickMap& tickMap)
+{
+    tickMap.searchTree.resize(tickMap.elements.size() + 1);
+    tickMap.searchTreeElementIndexes.resize(tickMap.elements.size() + 1);
+    
+    size_t elementIdx = 0;
+    fillSearchTree(tickMap, 1, elementIdx);
+}
+
+
+void TempoMap::fillSearchTree(TickMap& tickMap, size_t node, size_t& elementIdx)
+{
+    // in-order traversal of the tree: the elements (which are sorted) come out in the order of the nodes
+    if (node >= tickMap.searchTree.size())
+        return;
+    
+    fillSearchTree(tickMap, 2*node, elementIdx);
+    
+    tickMap.searchTree[node] = tickMap.elements[elementIdx].startPosition;
+    tickMap.searchTreeElementIndexes[node] = static_cast<uint32_t>(elementIdx);
+    elementIdx++;
+    
+    fillSearchTree(tickMap, 2*node+1, elementIdx);
+}
+
+
+std::vector<int64_t> TempoMap::getElementStartPositions() const
+{
+    std::vector<int64_t> startPositions;
+    
+    if (_tickMap != nullptr)
+        for (const TickMapElement& elt : _tickMap->elements)
+            startPositions.push_back(elt.startPosition);
+    
+    return startPositions;
+}
+
+
+size_t TempoMap::findElement(const TickMap& tickMap, TickPosition time)
+{
+    const TickPosition* tree = tickMap.searchTree.data();
+    const size_t treeSize = tickMap.searchTree.size();
+    
+    // we go down the whole tree without branching on the comparisons (they become conditional moves), remembering the
+    // last node where we went left: that is the first element starting after time
+    size_t node = 1;
+    size_t firstNodeAfter = 0;
+    
+    while (node < treeSize) {
+        const bool goRight = (tree[node] <= time);
+        firstNodeAfter = goRight ? firstNodeAfter : node;
+        node = 2*node + (goRight ? 1 : 0);
+    }
+    
+    const size_t firstElementAfter = (firstNodeAfter == 0) ? tickMap.elements.size() : tickMap.searchTreeElementIndexes[firstNodeAfter];
+    
+    return (firstElementAfter > 0) ? firstElementAfter - 1 : 0; // if we are before the first element we stay on it
+}
+
+
+int64_t TempoMap::ticksToReach(const TickMapElement& elt, int64_t fromTick, TickPosition targetPosition, TickPosition onTickTolerance)
+{
+    return std::max((int64_t)0, elt.getFirstTickFrom(targetPosition - onTickTolerance) - fromTick);
+}
+
+
+
+
+void TempoMap::publishTickMap(const std::shared_ptr<const TickMap>& tickMap)
+{
+    if (tickMap.get() != _lastPublishedTickMap) {
+        // if the audio thread did not take the previous one yet, it never will
+        delete _newTickMap.exchange (new TickMapSnapshot { tickMap }, std::memory_order_acq_rel);
+        _lastPublishedTickMap = tickMap.get();
+    }
+    
+    deleteOldTickMaps();
+}
+
+
+void TempoMap::tickMapPublished(double sampleRate)
+{
+    _publishedSampleRate = sampleRate;
+    _tickMapPublished.signal();
+}
+
+
+void TempoMap::deleteOldTickMaps()
+{
+    TickMapSnapshot* oldTickMap = _oldTickMaps.exchange (nullptr, std::memory_order_acquire);
+    
+    while (oldTickMap != nullptr) {
+        TickMapSnapshot* next = oldTickMap->nextOldSnapshot;
+        delete oldTickMap;
+        oldTickMap = next;
+    }
+}
@@ -27,86 +27,253 @@
 #pragma once
 
 
-class TempoMap : public juce::ARAMusicalContext::Listener,
-                 public juce::ARADocument::Listener
-{
-public:
-    TempoMap (juce::ARADocument& document);
+class TickMapCache;
 
-    ~TempoMap() override;
 
+// One per playback renderer: gives the ticks of the tick map built by the TickMapCache of the document for our sample rate
+// (or of a tick map built directly from events, see the second constructor).
+class TempoMap
+{
+public:
+    // copies of the host events (or events read from a file), so that the tick map can be built without accessing the ARA model graph
+    struct TempoEntry {
+        double timePosition; // in seconds
+        double quarterPosition;
+        
+        bool operator== (const TempoEntry& other) const { return timePosition == other.timePosition && quarterPosition == other.quarterPosition; }
+    };
+    
+    struct BarSignature {
+        int numerator;
+        int denominator;
+        double position; // in quarters
+        
+        bool operator== (const BarSignature& other) const { return numerator == other.numerator && denominator == other.denominator && position == other.position; }
+    };
+    
+    
+#if JucePlugin_Enable_ARA
+    TempoMap (TickMapCache& tickMapCache);
+#endif
     
-    void didAddMusicalContextToDocument (juce::ARADocument*, juce::ARAMusicalContext* musicalContext) override;
+    // Without a TickMapCache (e.g. the sync file generator, where there is no ARA host): the tick map is built right away
+    // from these events, and the sample rate cannot change
+    TempoMap (const std::vector<TempoEntry>& tempoEntries, const std::vector<BarSignature>& barSignatures, double sampleRate);
 
-    void willDestroyMusicalContext (juce::ARAMusicalContext* musicalContext) override;
+    ~TempoMap();
     
-    void doUpdateMusicalContextContent (juce::ARAMusicalContext* musicalContext, juce::ARAContentUpdateScopes scopeFlags) override;
+    
+    // Audio thread: to be called at the beginning of each block, takes the latest tick map published by the TickMapCache (if any).
+    // The functions below all use the tick map taken here, so it never changes in the middle of a block.
+    void updateTickMap();
     
     bool getTickAndBarLengthAtPosition(int64_t currentPos, double& tickLength, unsigned int& barLength);
     
     int64_t getNextTickPositionInSamples(int64_t currentPos, bool& lastTickRightBeforeABar);
     
     
+    struct Tick {
+        int64_t position; // position in samples
+        bool lastTickRightBeforeABar; // true = high tick, false = low tick
+        uint16_t subSamplePosition = 0; // with sub-sample ticks: where the tick is after position, in 1/65536 sample
+    };
+    
+    // Fills ticks with every tick in [blockStart, blockEnd) (positions in samples) and returns the amount of ticks written (at most maxTicks).
+    // firstTickAfterBlock is set to the first tick which was not written (normally the first tick at or after blockEnd).
+    // Consecutive contiguous blocks continue from where the previous call stopped, only a jump in position requires a new search.
+    int getTicksInBlock(int64_t blockStart, int64_t blockEnd, Tick* ticks, int maxTicks, Tick& firstTickAfterBlock);
+    
+    // The element search done on each jump in position (see findElement()), so that the sync file generator can measure it:
+    // the start positions of the elements of the tick map taken by updateTickMap() (in 1/65536 sample, see TickPosition),
+    // and the index of the element at a position in the same units. There must be a tick map.
+    std::vector<int64_t> getElementStartPositions() const;
+    size_t findElementAt(int64_t tickPosition) const { return findElement(*_tickMap, tickPosition); }
+    
+    
     // negative or positive delay in seconds
     void setDelay(double delay) { _delay = delay; }
     double getDelay() { return _delay; }
     
+    // By default tick positions are rounded to the nearest sample. With sub-sample ticks they are rounded down instead, and
+    // each Tick also gives its exact position within its sample, so that the signal can be placed more accurately (see
+    // SyncSignal::TickWaveforms::getDelayedTick())
+    void setSubSampleTicks(bool subSampleTicks) { _subSampleTicks = subSampleTicks; }
+    bool getSubSampleTicks() { return _subSampleTicks; }
     
-    static void setSampleRate(double sr) {
-        TempoMap::sampleRate = sr;
-        TempoMap::halfASampleLength = 1.0/(sr*2.0);
-    }
     
+    // To be called from prepareToPlay(): we get the tick map for this sample rate (possibly built by the TickMapCache thread,
+    // but we wait for it so that the first blocks do not use a tick map made for the previous sample rate)
+    void setSampleRate(double sampleRate);
     
     
-    static double sampleRate; // initialized in TempoMap.cpp (because static)
-    static double halfASampleLength;
+private:
     
+    friend class TickMapCache; // builds the tick maps with the functions below and publishes them to us
     
-    // Helper functions to compare double (time in seconds) with a precision of 0.5/sampleRate (e.g. about 10us for 48kHz)
-    static bool sampleScaleLessThan(double a, double b) {
-        return (a < b && !sampleScaleEquals(a, b));
-    }
-    static bool sampleScaleEquals(double a, double b) {
-        return (abs(a - b) <= halfASampleLength); // if the time diff is half a sample or less they are considered equal
-    }
+    // Positions in the tick map are fixed point numbers of 1/2^16 sample, at the sample rate the tick map was built for
+    // (about 0.3ns at 48kHz, and enough for years of audio even at 192kHz).
+    // Every tick is placed with a single rounding from the start of its element, so no error builds up over the song,
+    // and the audio thread only compares and shifts integers to get the sample of a tick.
+    using TickPosition = int64_t;
     
+    static constexpr int tickPositionFractionBits = 16;
+    static constexpr double tickPositionUnitsPerSample = 65536.0; // 2^16
     
-private:
+    static TickPosition toTickPosition(double seconds, double sampleRate) {
+        return static_cast<TickPosition>(llround(seconds * sampleRate * tickPositionUnitsPerSample));
+    }
     
-    void selectMusicalContext (juce::ARAMusicalContext* newSelectedMusicalContext);
+    // the host positions are rounded, so a tempo or time signature change this close to a tick is considered to be on it
+    static constexpr double onTickToleranceInSeconds = 0.000001; // 1us
     
+    // tempo changes are merged into a tempo ramp only if none of their ticks moves by more than this
+    static constexpr double rampToleranceInSeconds = 0.00000025; // i.e. 0.01 sample at 48kHz
     
-    void rebuildTickMap();
+    // the delay is a (negative or positive) offset added to all the tick positions
+    TickPosition getDelayOffset() const;
     
+    // first tick position which is rounded to samplePos or later, and the other way round
+    static TickPosition samplesToTickPosition(int64_t samplePos, TickPosition delayOffset) {
+        return samplePos * (1 << tickPositionFractionBits) - (1 << (tickPositionFractionBits-1)) - delayOffset;
+    }
+    static int64_t tickPositionToSamples(TickPosition tickPos, TickPosition delayOffset) {
+        return (tickPos + delayOffset + (1 << (tickPositionFractionBits-1))) >> tickPositionFractionBits; // rounded, also when negative
+    }
     
     
     struct TickMapElement {
-        double startPosition; // start position in seconds
-        double tickLength; // tick length in seconds
+        TickPosition startPosition; // start position
+        double tickLength; // length of the first tick in TickPosition units (not rounded)
+        double tickLengthIncrement; // tempo ramp: each tick is longer than the previous one by this (0 = constant tempo)
         unsigned int barLength; // bar length in amount of ticks
         unsigned int tickOffset; // in case this tick is not at the beginning of a bar, amount of ticks past the beginning of the bar
+        size_t firstTickIndex; // index of the first tick of this element (the ticks are numbered from the first element)
         
         
         TickMapElement()
-            : startPosition(0.0), tickLength(0.0), barLength(0), tickOffset(0)
+            : startPosition(0), tickLength(0.0), tickLengthIncrement(0.0), barLength(0), tickOffset(0), firstTickIndex(0)
         {
         }
         
-        TickMapElement(double startPosition, double tickLength = 0, unsigned int barLength = 0, unsigned int tickOffset = 0)
-            : startPosition(startPosition), tickLength(tickLength), barLength(barLength), tickOffset(tickOffset)
+        TickMapElement(TickPosition startPosition, double tickLength = 0, unsigned int barLength = 0, unsigned int tickOffset = 0)
+            : startPosition(startPosition), tickLength(tickLength), tickLengthIncrement(0.0), barLength(barLength), tickOffset(tickOffset), firstTickIndex(0)
         {
         }
         
-        friend bool operator< (const TickMapElement& elt1, const TickMapElement& elt2) {
-            return sampleScaleLessThan(elt1.startPosition, elt2.startPosition);
+        // Tick n of this element is at startPosition + round(n * tickLength + n*(n-1)/2 * tickLengthIncrement), so the ticks of
+        // a tempo ramp are computed directly, without going through the previous ones. Before the element start (n < 0, only
+        // possible before the first element) the tempo is constant.
+        TickPosition getTickPosition(int64_t ticksFromStart) const {
+            const double n = static_cast<double>(ticksFromStart);
+            const double rampOffset = (ticksFromStart > 0) ? n * (n - 1.0) / 2.0 * tickLengthIncrement : 0.0;
+            return startPosition + static_cast<TickPosition>(llround(n * tickLength + rampOffset));
+        }
+        
+        double getTickLength(int64_t ticksFromStart) const {
+            return (ticksFromStart > 0) ? tickLength + static_cast<double>(ticksFromStart) * tickLengthIncrement : tickLength;
+        }
+        
+        // not rounded: how many ticks from the start we are at time, i.e. the inverse of getTickPosition()
+        double getTicksFromStart(TickPosition time) const;
+        
+        // first tick at or after time, time must be reachable (tempo ramps can slow down but never stop)
+        int64_t getFirstTickFrom(TickPosition time) const;
+        
+        // same element = same ticks (as long as the next element starts at the same position)
+        bool sameTicksAs (const TickMapElement& other) const {
+            return startPosition == other.startPosition && tickLength == other.tickLength && tickLengthIncrement == other.tickLengthIncrement
+                && barLength == other.barLength && tickOffset == other.tickOffset;
         }
     };
 
-    juce::ARADocument& _araDocument;
-    juce::ARAMusicalContext* _selectedMusicalContext = nullptr;
-    std::vector<TickMapElement> _tickMap;
+    
+    
+    // A tick map is built entirely by buildTickMap() and never modified once published, so the audio threads can read it without locking
+    struct TickMap {
+        double sampleRate = 0.0; // of all the positions below
+        
+        std::vector<TickMapElement> elements;
+        
+        // The element start positions on their own, in Eytzinger order (the binary search tree stored as an implicit heap:
+        // node k has its children in 2k and 2k+1, the root is in 1 and 0 is unused), with the index of the matching element.
+        // A search then goes through memory in a predictable way and the first levels of the tree stay in cache.
+        std::vector<TickPosition> searchTree;
+        std::vector<uint32_t> searchTreeElementIndexes;
+        
+        size_t unchangedElements = 0; // the elements before the first change from the previous tick map
+    };
+    
+    // Returns nullptr if the events cannot make a tick map or if shouldCancel() returned true during the build.
+    // The build only goes through the events and the elements, never through the ticks themselves, so its cost does not
+    // depend on the length of the song. previousTickMap (if any) is only compared with, see TickMap::unchangedElements.
+    static std::unique_ptr<TickMap> buildTickMap(const std::vector<TempoEntry>& tempoEntries,
+                                                 const std::vector<BarSignature>& barSignatures,
+                                                 double sampleRate,
+                                                 const TickMap* previousTickMap,
+                                                 const std::function<bool()>& shouldCancel);
+    
+    // sets the firstTickIndex of the elements
+    static void numberTicks(TickMap& tickMap);
+    
+    // compact binary form of a tick map (for the ARA archive): only the elements are written, the tick numbers and the search
+    // tree are rebuilt from them when reading, which returns nullptr if the data does not make a valid tick map
+    static void writeTickMap(const TickMap& tickMap, juce::OutputStream& output);
+    static std::unique_ptr<TickMap> readTickMap(juce::InputStream& input);
+    
+    static void buildSearchTree(TickMap& tickMap);
+    static void fillSearchTree(TickMap& tickMap, size_t node, size_t& elementIdx);
+    
+    // index of the element at time, i.e. the last one starting at or before time (or the first one if time is before all of them)
+    static size_t findElement(const TickMap& tickMap, TickPosition time);
+    
+    // amount of ticks of elt needed to go from its tick fromTick to targetPosition (or within onTickTolerance of it)
+    static int64_t ticksToReach(const TickMapElement& elt, int64_t fromTick, TickPosition targetPosition, TickPosition onTickTolerance);
+    
+    // Tick indexes start from the first tick of the first element (they are negative before it). Every tick is computed
+    // directly from its element, eltIdx being the element of the last tick asked for: findNextTickIndex() (which returns the
+    // first tick at or after time) sets it, and getTick() moves it along, so going through consecutive ticks never searches.
+    static int64_t findNextTickIndex(const TickMap& tickMap, TickPosition time, size_t& eltIdx);
+    static void getTick(const TickMap& tickMap, int64_t tickIdx, size_t& eltIdx, TickPosition& tickPos, bool& lastTickRightBeforeABar);
+    
+    
+    // The tick maps are shared by the TempoMaps at the same sample rate, so we get them through snapshots which are our own:
+    // the audio thread only moves snapshot pointers around, and the reference to the tick map is released when the
+    // TickMapCache thread deletes the snapshot (the audio thread never deletes a tick map, even when it was the last user)
+    struct TickMapSnapshot {
+        std::shared_ptr<const TickMap> tickMap;
+        TickMapSnapshot* nextOldSnapshot = nullptr; // used to chain the snapshots given back by the audio thread
+    };
+    
+    // only called by the TickMapCache thread
+    void publishTickMap(const std::shared_ptr<const TickMap>& tickMap);
+    void tickMapPublished(double sampleRate); // we have the tick map for sampleRate (or there is nothing to build)
+    void deleteOldTickMaps();
+    
+
+    TickMapCache* _tickMapCache = nullptr; // nullptr if the tick map was built from events given to the constructor
     double _delay = 0.0;
+    bool _subSampleTicks = false;
+    
+    std::atomic<double> _sampleRate { 0.0 }; // the TickMapCache only builds tick maps for us once it is set
+    std::atomic<double> _publishedSampleRate { 0.0 }; // sample rate of the last tick map published to us
+    juce::WaitableEvent _tickMapPublished;
+    
+    // only used by the TickMapCache thread: the last tick map published to us (which stays valid since we hold a reference to it)
+    const TickMap* _lastPublishedTickMap = nullptr;
+    
+    // the TickMapCache thread publishes a new snapshot in _newTickMap, updateTickMap() takes it and gives back the one it was
+    // using in _oldTickMaps, which are deleted on the next publication: the audio thread never allocates, deletes nor waits
+    std::atomic<TickMapSnapshot*> _newTickMap { nullptr };
+    std::atomic<TickMapSnapshot*> _oldTickMaps { nullptr };
+    TickMapSnapshot* _tickMapSnapshot = nullptr; // only used by the audio thread
+    const TickMap* _tickMap = nullptr; // = _tickMapSnapshot->tickMap, what the audio thread reads
+    
+    // where getTicksInBlock() stopped
+    bool _cursorValid = false;
+    int64_t _cursorTickIdx = 0; // next tick to report
+    size_t _cursorElementIdx = 0; // its element
+    int64_t _cursorPosition = 0; // end of the last block, in samples
+    TickPosition _cursorDelayOffset = 0;
 };
 
  
@@ -0,0 +1,412 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "TickMapCache.h"
+
+
+using namespace juce;
+
+
+TickMapCache::TickMapCache (ARADocument& document)
+    : Thread ("MidroAudioSync TickMapCache"),
+      _araDocument (document)
+{
+    startThread();
+    
+    if (_araDocument.getMusicalContexts().size() > 0)
+        selectMusicalContext (_araDocument.getMusicalContexts().front());
+    
+    _araDocument.addListener (this);
+}
+
+TickMapCache::~TickMapCache()
+{
+    jassert (_tempoMaps.isEmpty()); // the playback renderers are destroyed before their document controller
+    
+    _araDocument.removeListener (this);
+    selectMusicalContext (nullptr);
+    
+    stopThread (-1); // a build in progress is cancelled as soon as threadShouldExit() is true
+}
+
+    
+void TickMapCache::didAddMusicalContextToDocument (ARADocument*, ARAMusicalContext* musicalContext)
+{
+    if (_selectedMusicalContext == nullptr)
+        selectMusicalContext (musicalContext);
+}
+
+void TickMapCache::willDestroyMusicalContext (ARAMusicalContext* musicalContext)
+{
+    if (_selectedMusicalContext == musicalContext)
+        selectMusicalContext (nullptr);
+}
+
+void TickMapCache::doUpdateMusicalContextContent (ARAMusicalContext* musicalContext, ARAContentUpdateScopes scopeFlags)
+{
+    if (_selectedMusicalContext != musicalContext)
+        selectMusicalContext (musicalContext);
+    else if (scopeFlags.affectTimeline())
+        rebuildTickMap();
+}
+
+
+void TickMapCache::addTempoMap (TempoMap& tempoMap)
+{
+    {
+        const ScopedLock lock (_tempoMapsLock);
+        _tempoMaps.addIfNotAlreadyThere (&tempoMap);
+    }
+    
+    notify(); // in case a tick map already exists at its sample rate
+}
+
+void TickMapCache::removeTempoMap (TempoMap& tempoMap)
+{
+    const ScopedLock lock (_tempoMapsLock); // also waits for publishTickMaps() if it is running
+    _tempoMaps.removeFirstMatchingValue (&tempoMap);
+}
+
+
+
+
+void TickMapCache::selectMusicalContext (ARAMusicalContext* newSelectedMusicalContext)
+{
+    if (auto oldContext = std::exchange (_selectedMusicalContext, newSelectedMusicalContext);
+        oldContext != _selectedMusicalContext)
+    {
+        if (oldContext != nullptr)
+            oldContext->removeListener (this);
+
+        if (_selectedMusicalContext != nullptr)
+            _selectedMusicalContext->addListener (this);
+    }
+    
+    rebuildTickMap();
+}
+
+
+
+void TickMapCache::rebuildTickMap()
+{
+    if (_selectedMusicalContext != nullptr)
+    {
+        // see documentation: ARA_SDK/ARA_Library/html_docs/group___model___timeline.html
+        const ARA::PlugIn::HostContentReader<ARA::kARAContentTypeTempoEntries> tempoReader (_selectedMusicalContext);
+        const ARA::PlugIn::HostContentReader<ARA::kARAContentTypeBarSignatures> barSigReader (_selectedMusicalContext);
+        
+        if (tempoReader && barSigReader && tempoReader.getEventCount() > 1 && barSigReader.getEventCount() > 0)
+        {
+            // we only copy the events here, the tick maps themselves are built on our own thread (see run())
+            auto request = std::make_unique<RebuildRequest>();
+            
+            for (ARA::ARAInt32 i = 0 ; i < tempoReader.getEventCount() ; i++)
+                request->tempoEntries.push_back({tempoReader[i].timePosition, tempoReader[i].quarterPosition});
+            
+            for (ARA::ARAInt32 i = 0 ; i < barSigReader.getEventCount() ; i++)
+                request->barSignatures.push_back({barSigReader[i].numerator, barSigReader[i].denominator, barSigReader[i].position});
+            
+            request->eventsHash = hashEvents (*request);
+            request->requestTime = Time::getMillisecondCounterHiRes();
+            
+            {
+                const ScopedLock lock (_rebuildRequestLock);
+                
+                request->id = ++_latestRebuildRequestId; // a build still running for an older request will stop by itself
+                
+                if (_rebuildRequest != nullptr)
+                    _rebuildStats.skippedBuilds++; // the thread did not even start it, this one replaces it
+                _rebuildStats.requestedBuilds++;
+                
+                _rebuildRequest = std::move(request);
+            }
+            
+            notify();
+        }
+    }
+}
+
+
+
+void TickMapCache::run()
+{
+    while (!threadShouldExit())
+    {
+        std::unique_ptr<RebuildRequest> request;
+        
+        {
+            const ScopedLock lock (_rebuildRequestLock);
+            request = std::move(_rebuildRequest);
+        }
+        
+        if (request != nullptr && _lastBuiltRequest != nullptr
+            && request->tempoEntries == _lastBuiltRequest->tempoEntries
+            && request->barSignatures == _lastBuiltRequest->barSignatures) {
+            _rebuildStats.unchangedRequests++;
+            request = nullptr;
+        }
+        
+        std::vector<double> sampleRates;
+        {
+            const ScopedLock lock (_tempoMapsLock);
+            
+            for (auto* tempoMap : _tempoMaps) {
+                const double sampleRate = tempoMap->_sampleRate.load();
+                if (sampleRate > 0.0 && std::find(sampleRates.begin(), sampleRates.end(), sampleRate) == sampleRates.end())
+                    sampleRates.push_back(sampleRate);
+            }
+        }
+        
+        // new events: every tick map is rebuilt (compared with the previous one at the same sample rate),
+        // otherwise we only build the ones for the sample rates which are new
+        const RebuildRequest* events = (request != nullptr) ? request.get() : _lastBuiltRequest.get();
+        const uint64_t requestId = (request != nullptr) ? request->id : _latestRebuildRequestId.load();
+        
+        std::map<double, std::shared_ptr<const TempoMap::TickMap>> tickMaps;
+        bool cancelled = false;
+        
+        for (size_t i = 0 ; events != nullptr && i < sampleRates.size() && !cancelled ; i++) {
+            const double sampleRate = sampleRates[i];
+            auto previous = _tickMaps.find(sampleRate);
+            
+            if (request == nullptr && previous != _tickMaps.end()) {
+                tickMaps[sampleRate] = previous->second;
+                continue;
+            }
+            
+            if (auto restoredTickMap = findRestoredTickMap (events->eventsHash, sampleRate)) {
+                _rebuildStats.restoredTickMaps++;
+                tickMaps[sampleRate] = std::move(restoredTickMap);
+                continue;
+            }
+            
+            auto newTickMap = TempoMap::buildTickMap(events->tempoEntries, events->barSignatures, sampleRate,
+                                                     (previous != _tickMaps.end()) ? previous->second.get() : nullptr,
+                                                     [this, requestId, &cancelled] {
+                cancelled = (threadShouldExit() || _latestRebuildRequestId.load() != requestId);
+                return cancelled;
+            });
+            
+            if (newTickMap != nullptr) {
+                _rebuildStats.builtTickMaps++;
+                _rebuildStats.unchangedElements += newTickMap->unchangedElements;
+                _rebuildStats.changedElements += newTickMap->elements.size() - newTickMap->unchangedElements;
+                
+                tickMaps[sampleRate] = std::move(newTickMap);
+            }
+        }
+        
+        if (cancelled) {
+            if (request != nullptr) // (a build for a new sample rate only was not requested by the host)
+                _rebuildStats.skippedBuilds++;
+            continue;
+        }
+        
+        // the tick maps of the sample rates nobody uses anymore are dropped (a TempoMap still using one keeps it alive)
+        const bool newEvents = (request != nullptr);
+        {
+            const ScopedLock lock (_archiveLock);
+            
+            _tickMaps.swap(tickMaps);
+            
+            if (newEvents) {
+                _lastBuiltRequest = std::move(request);
+                
+                if (_lastBuiltRequest->eventsHash != _restoredEventsHash)
+                    _restoredTickMaps.clear(); // the events changed since the project was saved
+            }
+        }
+        
+        tickMaps.clear(); // the replaced tick maps must not stay alive while we wait for the next request
+        publishTickMaps();
+        
+        if (newEvents) {
+            const double latency = Time::getMillisecondCounterHiRes() - _lastBuiltRequest->requestTime;
+            _rebuildStats.completedBuilds++;
+            _rebuildStats.lastLatencyMs = latency;
+            if (latency > _rebuildStats.maxLatencyMs)
+                _rebuildStats.maxLatencyMs = latency;
+            
+            DBG ("TickMapCache: tick maps published " << latency << " ms after the host update ("
+                 << (int64) _rebuildStats.completedBuilds.load() << " builds completed, "
+                 << (int64) _rebuildStats.skippedBuilds.load() << " skipped, out of "
+                 << (int64) _rebuildStats.requestedBuilds.load() << " requests), elements unchanged: "
+                 << (int64) _rebuildStats.unchangedElements.load() << ", changed: "
+                 << (int64) _rebuildStats.changedElements.load());
+            
+            continue; // a newer request may already be waiting
+        }
+        
+        wait (-1); // until the next rebuildTickMap(), addTempoMap(), sampleRateChanged() or the end of the thread
+    }
+}
+
+
+void TickMapCache::publishTickMaps()
+{
+    const ScopedLock lock (_tempoMapsLock);
+    
+    for (auto* tempoMap : _tempoMaps) {
+        const double sampleRate = tempoMap->_sampleRate.load();
+        auto tickMap = _tickMaps.find(sampleRate);
+        
+        if (tickMap != _tickMaps.end())
+            tempoMap->publishTickMap(tickMap->second);
+        else if (_lastBuiltRequest != nullptr)
+            continue; // its sample rate changed since we built, we will be notified again
+        else
+            tempoMap->deleteOldTickMaps(); // nothing to build yet, so nothing to wait for in setSampleRate()
+        
+        tempoMap->tickMapPublished(sampleRate);
+    }
+}
+
+
+
+std::map<double, std::weak_ptr<const void>> TickMapCache::getTickMapReferences() const
+{
+    const ScopedLock lock (_archiveLock);
+    std::map<double, std::weak_ptr<const void>> tickMapReferences;
+    
+    for (const auto& tickMap : _tickMaps)
+        tickMapReferences[tickMap.first] = tickMap.second;
+    
+    return tickMapReferences;
+}
+
+
+bool TickMapCache::storeTickMaps (OutputStream& output)
+{
+    uint64_t eventsHash = 0;
+    std::map<double, std::shared_ptr<const TempoMap::TickMap>> tickMaps;
+    
+    {
+        const ScopedLock lock (_archiveLock);
+        
+        if (_lastBuiltRequest != nullptr) {
+            eventsHash = _lastBuiltRequest->eventsHash;
+            tickMaps = _tickMaps;
+        }
+        else {
+            eventsHash = _restoredEventsHash;
+        }
+        
+        // the restored tick maps which were not needed (yet) are kept as long as they match the events
+        if (eventsHash == _restoredEventsHash)
+            tickMaps.insert(_restoredTickMaps.begin(), _restoredTickMaps.end());
+    }
+    
+    // written in memory first, so that the ARA archive gets everything in one go
+    MemoryOutputStream stream;
+    stream.writeInt(archiveMagic);
+    stream.writeInt(archiveVersion);
+    stream.writeInt64(static_cast<int64>(eventsHash));
+    stream.writeInt(static_cast<int>(tickMaps.size()));
+    
+    for (auto& tickMap : tickMaps)
+        TempoMap::writeTickMap(*tickMap.second, stream);
+    
+    return output.write(stream.getData(), stream.getDataSize());
+}
+
+
+void TickMapCache::restoreTickMaps (InputStream& input)
+{
+    if (input.readInt() != archiveMagic || input.readInt() != archiveVersion)
+        return;
+    
+    const uint64_t eventsHash = static_cast<uint64_t>(input.readInt64());
+    const int numTickMaps = input.readInt();
+    
+    std::map<double, std::shared_ptr<const TempoMap::TickMap>> restoredTickMaps;
+    
+    for (int i = 0 ; i < numTickMaps ; i++) {
+        std::shared_ptr<const TempoMap::TickMap> tickMap = TempoMap::readTickMap(input);
+        if (tickMap == nullptr)
+            return;
+        
+        restoredTickMaps[tickMap->sampleRate] = std::move(tickMap);
+    }
+    
+    {
+        const ScopedLock lock (_archiveLock);
+        _restoredEventsHash = eventsHash;
+        _restoredTickMaps.swap(restoredTickMaps);
+    }
+    
+    notify(); // a TempoMap may be waiting for one of them
+}
+
+
+std::shared_ptr<const TempoMap::TickMap> TickMapCache::findRestoredTickMap (uint64_t eventsHash, double sampleRate)
+{
+    const ScopedLock lock (_archiveLock);
+    
+    if (eventsHash != _restoredEventsHash)
+        return nullptr;
+    
+    auto tickMap = _restoredTickMaps.find(sampleRate);
+    return (tickMap != _restoredTickMaps.end()) ? tickMap->second : nullptr;
+}
+
+
+uint64_t TickMapCache::hashEvents (const RebuildRequest& request)
+{
+    // FNV-1a over the events exactly as the host gave them, as fixed-size values in a fixed byte order: the hash is stored
+    // in the ARA archive, so it must be the same on every platform (32 or 64-bit, whatever the endianness)
+    uint64_t hash = 14695981039346656037ull;
+    
+    auto add = [&hash] (uint64_t value) {
+        for (int i = 0 ; i < 8 ; i++) { // least significant byte first
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    
+    auto addDouble = [&add] (double value) {
+        uint64_t bits = 0;
+        static_assert (sizeof (bits) == sizeof (value), "doubles are hashed as their 64-bit pattern");
+        std::memcpy (&bits, &value, sizeof (bits));
+        add (bits);
+    };
+    
+    add (static_cast<uint64_t> (request.tempoEntries.size()));
+    
+    for (const auto& tempoEntry : request.tempoEntries) {
+        addDouble (tempoEntry.timePosition);
+        addDouble (tempoEntry.quarterPosition);
+    }
+    
+    add (static_cast<uint64_t> (request.barSignatures.size()));
+    
+    for (const auto& barSignature : request.barSignatures) {
+        add (static_cast<uint64_t> (static_cast<int64_t> (barSignature.numerator)));
+        add (static_cast<uint64_t> (static_cast<int64_t> (barSignature.denominator)));
+        addDouble (barSignature.position);
+    }
+    
+    return hash;
+}
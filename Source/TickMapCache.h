@@ -0,0 +1,144 @@
+/*
+    ==============================================================================
+
+    This file is part of the MidroAudioSync plugin, a plugin for Digital Audio
+    Workstations (DAW) whose purpose is to synchronize DAWs with the Midronome
+    (more info on <https://www.midronome.com/>).
+ 
+    Copyright © 2023 - Simon Lasnier
+
+    The MidroAudioSync plugin is free software: you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    The MidroAudioSync plugin is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+    or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    the MidroAudioSync plugin. If not, see <https://www.gnu.org/licenses/>.
+ 
+    ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "TempoMap.h"
+
+
+// One per document (owned by the document controller): listens to the musical context, builds its tick map on its own thread
+// and hands it to the TempoMap of every playback renderer. A tick map is built once for each sample rate in use, and all the
+// TempoMaps at that sample rate share it (tick maps are never modified once built).
+class TickMapCache : public juce::ARAMusicalContext::Listener,
+                     public juce::ARADocument::Listener,
+                     private juce::Thread
+{
+public:
+    TickMapCache (juce::ARADocument& document);
+
+    ~TickMapCache() override;
+
+    
+    void didAddMusicalContextToDocument (juce::ARADocument*, juce::ARAMusicalContext* musicalContext) override;
+
+    void willDestroyMusicalContext (juce::ARAMusicalContext* musicalContext) override;
+    
+    void doUpdateMusicalContextContent (juce::ARAMusicalContext* musicalContext, juce::ARAContentUpdateScopes scopeFlags) override;
+    
+    
+    // called by the TempoMaps themselves: from then on (and until removeTempoMap()) our thread publishes the tick maps to them
+    void addTempoMap (TempoMap& tempoMap);
+    void removeTempoMap (TempoMap& tempoMap);
+    
+    // a TempoMap needs a tick map for another sample rate
+    void sampleRateChanged() { notify(); }
+    
+    
+    // The compiled tick maps are stored in the ARA archive with a hash of the events they were built from, so that they can
+    // be used as they are when the project is opened again: they are only rebuilt if the events of the host do not match.
+    // Our data is only a cache, so restoring ignores what it cannot read (e.g. archives written by an older version).
+    bool storeTickMaps (juce::OutputStream& output);
+    void restoreTickMaps (juce::InputStream& input);
+    
+    
+    // the tick maps are rebuilt on our thread, these let us check how it keeps up with the host (e.g. when dragging a tempo curve)
+    struct RebuildStats {
+        std::atomic<uint64_t> requestedBuilds { 0 }; // one per tempo/bar signature update from the host
+        std::atomic<uint64_t> completedBuilds { 0 }; // requests whose tick maps were published to the audio threads
+        std::atomic<uint64_t> skippedBuilds { 0 }; // replaced by a newer request before being started, or cancelled while building
+        std::atomic<double> lastLatencyMs { 0.0 }; // from the host update to the publication of the tick maps
+        std::atomic<double> maxLatencyMs { 0.0 };
+        std::atomic<uint64_t> unchangedRequests { 0 }; // same events as the last build, nothing to do
+        std::atomic<uint64_t> builtTickMaps { 0 }; // one per sample rate in use for each request (or when a new sample rate is needed)
+        std::atomic<uint64_t> restoredTickMaps { 0 }; // taken from the ARA archive instead of being built
+        std::atomic<uint64_t> unchangedElements { 0 }; // elements the same as in the previous tick map (everything before the first change)
+        std::atomic<uint64_t> changedElements { 0 };
+    };
+    
+    const RebuildStats& getRebuildStats() const { return _rebuildStats; }
+    
+    // The tick map we keep for each sample rate in use, as opaque weak references: enough to check how many TempoMaps
+    // share it (use_count() - 1, ours) and that the ones we replaced get freed, without access to the tick maps themselves
+    std::map<double, std::weak_ptr<const void>> getTickMapReferences() const;
+    
+    
+private:
+    
+    void selectMusicalContext (juce::ARAMusicalContext* newSelectedMusicalContext);
+    
+    void rebuildTickMap();
+    
+    void run() override;
+    
+    // gives each TempoMap the tick map at its sample rate (if it does not have it yet) and deletes what they gave back
+    void publishTickMaps();
+    
+    
+    struct RebuildRequest {
+        std::vector<TempoMap::TempoEntry> tempoEntries;
+        std::vector<TempoMap::BarSignature> barSignatures;
+        uint64_t eventsHash = 0; // see hashEvents()
+        uint64_t id = 0;
+        double requestTime = 0.0; // Time::getMillisecondCounterHiRes()
+    };
+    
+    
+    // to be changed whenever the archive format or the way tick maps are built changes (older archives are then ignored)
+    static constexpr int archiveMagic = 0x4d41544d; // "MATM"
+    static constexpr int archiveVersion = 4;
+    
+    static uint64_t hashEvents (const RebuildRequest& request);
+    
+    // the tick map restored from the ARA archive for these events and this sample rate, if any
+    std::shared_ptr<const TempoMap::TickMap> findRestoredTickMap (uint64_t eventsHash, double sampleRate);
+    
+    
+    juce::ARADocument& _araDocument;
+    juce::ARAMusicalContext* _selectedMusicalContext = nullptr;
+    
+    // rebuildTickMap() only posts a request, our thread builds the latest one and skips those which were replaced in the meantime
+    juce::CriticalSection _rebuildRequestLock;
+    std::unique_ptr<RebuildRequest> _rebuildRequest; // protected by _rebuildRequestLock
+    std::atomic<uint64_t> _latestRebuildRequestId { 0 };
+    RebuildStats _rebuildStats;
+    
+    // the TempoMaps of the playback renderers, the lock is never taken by an audio thread
+    juce::CriticalSection _tempoMapsLock;
+    juce::Array<TempoMap*> _tempoMaps; // protected by _tempoMapsLock
+    
+    // only changed by our thread (under _archiveLock, so that storeTickMaps() can read them): what the current tick maps were
+    // built from, and the tick map for each sample rate in use
+    std::unique_ptr<RebuildRequest> _lastBuiltRequest;
+    std::map<double, std::shared_ptr<const TempoMap::TickMap>> _tickMaps;
+    
+    // what restoreTickMaps() read, kept until our thread builds tick maps for other events
+    uint64_t _restoredEventsHash = 0; // protected by _archiveLock
+    std::map<double, std::shared_ptr<const TempoMap::TickMap>> _restoredTickMaps; // protected by _archiveLock
+    juce::CriticalSection _archiveLock;
+    
+    JUCE_DECLARE_NON_COPYABLE (TickMapCache)
+};